@@ -16,48 +16,179 @@ char *extract_alias_value(const char *input) {
     return value;
 }
 
-void add_alias(const char *name, const char *value) {
-    if (alias_count >= MAX_ALIASES) {
-        fprintf(stderr, " Quantis: Too many aliases.\n");
-        return;
+/* aliases[] keeps insertion order for listing and saving; the slot
+ * table maps a name hash to its index in aliases[]. */
+static int *alias_slots = NULL;
+static size_t alias_slot_cap = 0;
+
+static size_t alias_slot(const char *name) {
+    size_t mask = alias_slot_cap - 1;
+    size_t i = hash_string(name) & mask;
+    while (alias_slots[i] >= 0 &&
+           strcmp(aliases[alias_slots[i]].name, name) != 0)
+        i = (i + 1) & mask;
+    return i;
+}
+
+static int rebuild_alias_slots(size_t cap) {
+    int *slots = malloc(cap * sizeof(int));
+    if (!slots) return 0;
+    for (size_t i = 0; i < cap; i++) slots[i] = -1;
+
+    free(alias_slots);
+    alias_slots = slots;
+    alias_slot_cap = cap;
+    for (int i = 0; i < alias_count; i++)
+        alias_slots[alias_slot(aliases[i].name)] = i;
+    return 1;
+}
+
+/* Lex the value once into a word template. Expansion splices these
+ * words into the parsed command and expands them like typed words, so
+ * quotes, $VAR and ~ work as on the command line. A trailing "&" marks
+ * the alias as a background command; other operators are rejected. */
+static int compile_alias(alias_t *a, const char *name) {
+    a->words = strdup(a->value);
+    if (!a->words) {
+        perror("malloc for alias template");
+        return 0;
+    }
+
+    arena_t scratch;
+    token_t *tokens;
+    int ntokens;
+    arena_init(&scratch);
+    int ok = lex_line(&scratch, a->words, &tokens, &ntokens);
+    if (ok) {
+        a->argv = malloc(ntokens * sizeof(word_t));
+        if (!a->argv) {
+            perror("malloc for alias template");
+            ok = 0;
+        }
     }
+
+    for (int i = 0; ok && tokens[i].type != TOK_END; i++) {
+        token_t *t = &tokens[i];
+        if (t->type == TOK_AMP && tokens[i + 1].type == TOK_END) {
+            a->bg = 1;
+        } else if (t->type != TOK_WORD) {
+            fprintf(stderr, " Quantis: alias %s: only words and a "
+                            "trailing & may appear in a value.\n", name);
+            ok = 0;
+        } else {
+            /* Later tokens start at or past this NUL, so it can be
+             * written before they are read. */
+            t->text[t->len] = '\0';
+            a->argv[a->argc].text = t->text;
+            a->argv[a->argc++].flags = t->flags;
+        }
+    }
+    arena_free(&scratch);
+    return ok;
+}
+
+static void release_alias(alias_t *a) {
+    free(a->value);
+    free(a->words);
+    free(a->argv);
+    free(a->expanded);
+}
+
+alias_t *find_alias(const char *name) {
+    if (!alias_slot_cap) return NULL;
+    int idx = alias_slots[alias_slot(name)];
+    return idx >= 0 ? &aliases[idx] : NULL;
+}
+
+int add_alias(const char *name, const char *value) {
     if (strcmp(name, "alias") == 0) {
         fprintf(stderr, " Quantis: Cannot make an alias for alias.\n");
-        return;
+        return 0;
     } else if (strcmp(name, "unalias") == 0) {
         fprintf(stderr, " Quantis: Cannot make an alias for unalias.\n");
-        return;
+        return 0;
     } else if (strcmp(name, "cd") == 0) {
         fprintf(stderr, " Quantis: Cannot make an alias for cd.\n");
-        return;
+        return 0;
     }
 
-    char *value_copy = strdup(value);
+    alias_t compiled = { 0 };
+    compiled.value = strdup(value);
+    if (!compiled.value) {
+        perror("malloc for alias value");
+        return 0;
+    }
+    if (!compile_alias(&compiled, name)) {
+        release_alias(&compiled);
+        return 0;
+    }
 
-    for (int i = 0; i < alias_count; i++) {
-        if (strcmp(aliases[i].name, name) == 0) {
-            free(aliases[i].value);
-            aliases[i].value = value_copy;
-            return;
+    alias_generation++;
+
+    alias_t *existing = find_alias(name);
+    if (existing) {
+        compiled.name = existing->name;
+        release_alias(existing);
+        *existing = compiled;
+        return 1;
+    }
+
+    if (alias_count == alias_cap) {
+        int new_cap = alias_cap ? alias_cap * 2 : 16;
+        alias_t *grown = realloc(aliases, new_cap * sizeof(alias_t));
+        if (!grown) {
+            perror("realloc for aliases");
+            release_alias(&compiled);
+            return 0;
         }
+        aliases = grown;
+        alias_cap = new_cap;
+    }
+    if ((size_t)(alias_count + 1) * 2 > alias_slot_cap &&
+        !rebuild_alias_slots(alias_slot_cap ? alias_slot_cap * 2 : 32)) {
+        perror("malloc for alias table");
+        release_alias(&compiled);
+        return 0;
     }
 
-    aliases[alias_count].name = strdup(name);
-    aliases[alias_count].value = value_copy;
+    compiled.name = strdup(name);
+    if (!compiled.name) {
+        perror("malloc for alias name");
+        release_alias(&compiled);
+        return 0;
+    }
+    aliases[alias_count] = compiled;
+    alias_slots[alias_slot(name)] = alias_count;
     alias_count++;
+    return 1;
 }
 
 void remove_alias(const char *name) {
-    for (int i = 0; i < alias_count; i++) {
-        if (strcmp(aliases[i].name, name) == 0) {
-            free(aliases[i].name);
-            free(aliases[i].value);
-            for (int j = i; j < alias_count - 1; j++) {
-                aliases[j] = aliases[j + 1];
-            }
-            alias_count--;
-            return;
-        }
+    alias_t *a = find_alias(name);
+    if (!a) return;
+
+    alias_generation++;
+
+    int i = (int)(a - aliases);
+    free(a->name);
+    release_alias(a);
+    for (int j = i; j < alias_count - 1; j++) {
+        aliases[j] = aliases[j + 1];
     }
+    alias_count--;
+    rebuild_alias_slots(alias_slot_cap);
 }
 
+void free_aliases(void) {
+    for (int i = 0; i < alias_count; i++) {
+        free(aliases[i].name);
+        release_alias(&aliases[i]);
+    }
+    free(aliases);
+    aliases = NULL;
+    alias_count = 0;
+    alias_cap = 0;
+    free(alias_slots);
+    alias_slots = NULL;
+    alias_slot_cap = 0;
+}
@@ -1,68 +1,116 @@
 #include "quantis.h"
 
-char *expand_aliases(const char *input_line) {
-    char *temp_line = strdup(input_line);
-    if (!temp_line) return strdup(input_line);
-
-    char *first_word = strtok(temp_line, " \t");
-
-    if (!first_word) {
-        free(temp_line);
-        return strdup(input_line);
+static int cycle_cut = 0;
+
+/* Resolve an alias whose first word is itself an alias. The result is
+ * memoized until any alias changes; a word that would close a cycle is
+ * left as a literal command name. Results that depend on where the
+ * cycle was entered are not memoized. */
+static int resolve_alias(alias_t *a) {
+    if (a->expanded_gen == alias_generation) return a->expanded != NULL;
+
+    free(a->expanded);
+    a->expanded = NULL;
+    a->expanded_argc = 0;
+
+    alias_t *inner = NULL;
+    if (a->argc > 0 && !(a->argv[0].flags & WORD_EXPAND))
+        inner = find_alias(a->argv[0].text);
+    if (inner == a) inner = NULL;
+    if (inner && inner->resolving) {
+        cycle_cut = 1;
+        inner = NULL;
     }
 
-    for (int i = 0; i < alias_count; i++) {
-        if (strcmp(first_word, aliases[i].name) == 0) {
-            const char *alias_value = aliases[i].value;
-            size_t len = strlen(alias_value);
-
-            size_t first_word_len = strlen(first_word);
-            const char *rest_of_line = input_line + first_word_len;
-
-            while (*rest_of_line == ' ' || *rest_of_line == '\t') {
-                rest_of_line++;
-            }
-
-            size_t rest_len = strlen(rest_of_line);
-            size_t expanded_len =
-                len + (rest_len > 0 ? 1 : 0) + rest_len + 1;
-
-            char *expanded = malloc(expanded_len);
-            if (!expanded) {
-                perror("malloc for expanded alias");
-                free(temp_line);
-                return strdup(input_line);
-            }
-
-            strcpy(expanded, alias_value);
-
-            if (rest_len > 0) {
-                strcat(expanded, " ");
-                strcat(expanded, rest_of_line);
-            }
-
-            free(temp_line);
-            return expanded;
+    word_t *head = a->argv;
+    int head_argc = a->argc > 0 ? 1 : 0;
+    int bg = a->bg;
+    if (inner) {
+        a->resolving = 1;
+        int ok = resolve_alias(inner);
+        a->resolving = 0;
+        if (ok) {
+            head = inner->expanded;
+            head_argc = inner->expanded_argc;
+            bg |= inner->expanded_bg;
         }
     }
 
-    free(temp_line);
-    return strdup(input_line);
+    int total = head_argc + (a->argc > 0 ? a->argc - 1 : 0);
+    a->expanded = malloc((total + 1) * sizeof(word_t));
+    if (!a->expanded) return 0;
+
+    int n = 0;
+    for (int i = 0; i < head_argc; i++)
+        a->expanded[n++] = head[i];
+    for (int i = 1; i < a->argc; i++)
+        a->expanded[n++] = a->argv[i];
+    a->expanded_argc = n;
+    a->expanded_bg = bg;
+    a->expanded_gen = cycle_cut ? 0 : alias_generation;
+    return 1;
 }
 
-void load_aliases(const char *rc_file) {
-    FILE *f = fopen(rc_file, "r");
-    if (!f) return;
+/* Replace an alias in argv[0] by its words followed by the rest of
+ * argv, in a new arena array. The alias words are expanded here, as the
+ * typed ones were. Returns argv when no alias applies, NULL when out of
+ * memory. */
+char **expand_alias_argv(arena_t *ar, char **argv, int argc, int *bg) {
+    if (argc == 0) return argv;
+
+    alias_t *a = find_alias(argv[0]);
+    cycle_cut = 0;
+    if (!a || !resolve_alias(a)) return argv;
+
+    int n = a->expanded_argc;
+    char **out = arena_alloc(ar, (n + argc) * sizeof(char *));
+    if (!out) return NULL;
+    for (int i = 0; i < n; i++) {
+        out[i] = expand_word(ar, &a->expanded[i]);
+        if (!out[i]) return NULL;
+    }
+    /* argv[1..argc] is the rest of the command and its NULL. */
+    memcpy(out + n, argv + 1, argc * sizeof(char *));
+    if (a->expanded_bg) *bg = 1;
+    return out;
+}
+
+/* Apply the alias/unalias records from offset to the end of the open
+ * file in order; returns the offset just past the last complete line.
+ * Lines are read whole, however long. */
+long replay_aliases(int fd, long offset, int *records) {
+    int copy = dup(fd);
+    FILE *f = (copy >= 0) ? fdopen(copy, "r") : NULL;
+    if (!f) {
+        if (copy >= 0) close(copy);
+        return offset;
+    }
+    if (fseek(f, offset, SEEK_SET) != 0) {
+        fclose(f);
+        return offset;
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t raw_len;
+    while ((raw_len = getline(&line, &cap, f)) > 0) {
+        /* An unterminated last line is applied but not consumed, so
+         * it is read again once its writer finishes it. */
+        if (line[raw_len - 1] == '\n') offset += (long)raw_len;
 
-    char line[1024];
-    while (fgets(line, sizeof(line), f)) {
         line[strcspn(line, "\n")] = 0;
         char *trimmed = line;
         while (*trimmed == ' ' || *trimmed == '\t') trimmed++;
 
         if (strlen(trimmed) == 0 || trimmed[0] == '#') continue;
 
-        if (strncmp(trimmed, "alias ", 6) == 0) {
+        if (strncmp(trimmed, "unalias ", 8) == 0) {
+            char *name = trimmed + 8;
+            while (*name == ' ' || *name == '\t') name++;
+            name[strcspn(name, " \t")] = '\0';
+            if (*name) remove_alias(name);
+            (*records)++;
+        } else if (strncmp(trimmed, "alias ", 6) == 0) {
             char *alias_def = trimmed + 6;
             char *colon = strchr(alias_def, ':');
             if (!colon) continue;
@@ -82,7 +130,25 @@ void load_aliases(const char *rc_file) {
                 add_alias(name, value);
             }
             if (value) free(value);
+            (*records)++;
         }
     }
+    free(line);
     fclose(f);
+    return offset;
+}
+
+void load_aliases(const char *rc_file) {
+    int records = 0;
+    long end = 0;
+    struct stat st;
+
+    int fd = open(rc_file, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0 && fstat(fd, &st) == 0) {
+        end = replay_aliases(fd, 0, &records);
+        alias_journal_loaded(rc_file, &st, end, records);
+    } else {
+        alias_journal_loaded(rc_file, NULL, 0, 0);
+    }
+    if (fd >= 0) close(fd);
 }
@@ -1,22 +1,173 @@
 #include "quantis.h"
+#ifndef __seele__
+#include <sys/file.h>
+#endif
 
+#define ALIAS_RC_HEADER \
+    "# .qnrc\n" \
+    "# Quantis RC file\n\n" \
+    "# This file is used for storing created aliases.\n" \
+    "# It is not recommended to manually change the contents of this file.\n\n" \
+    "# Use the builtin alias and unalias commands to modify your aliases.\n\n"
+
+/* The rc file is a journal: alias and unalias records are appended as
+ * they happen and replayed in order on load. rc_offset is how far this
+ * shell has replayed the file identified by rc_dev/rc_ino, so records
+ * appended by other shells can be picked up before it is compacted.
+ * Appends and compactions happen under an exclusive flock. */
+static long rc_offset = 0;
+static dev_t rc_dev = 0;
+static ino_t rc_ino = 0;
+static int rc_records = 0;
+static int rc_dirty = 0;
+
+static int journal_bloated(void) {
+    return rc_records > alias_count * 2 + ALIAS_JOURNAL_SLACK;
+}
+
+static void lock_rc(int fd, int exclusive) {
+#ifndef __seele__
+    while (flock(fd, exclusive ? LOCK_EX : LOCK_UN) < 0 && errno == EINTR)
+        ;
+#else
+    (void)fd;
+    (void)exclusive;
+#endif
+}
+
+/* Open and lock the rc file, retrying if another shell renamed a new
+ * file over the path while we waited for the lock. */
+static int open_locked(const char *rc_file) {
+    while (1) {
+        int fd = open(rc_file, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC,
+                      0644);
+        if (fd < 0) return -1;
+        lock_rc(fd, 1);
+
+        struct stat held, now;
+        if (fstat(fd, &held) == 0 &&
+            (stat(rc_file, &now) != 0 ||
+             (now.st_dev == held.st_dev && now.st_ino == held.st_ino)))
+            return fd;
+        close(fd);
+    }
+}
+
+/* Replay what other shells appended since we last looked. If the file
+ * was compacted in the meantime it is a different file, and our offset
+ * means nothing in it: replay it from the start. Records are idempotent
+ * so re-applying ones already seen is harmless. */
+static void catch_up(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) return;
+    if (st.st_dev != rc_dev || st.st_ino != rc_ino) {
+        rc_dev = st.st_dev;
+        rc_ino = st.st_ino;
+        rc_offset = 0;
+        rc_records = 0;
+    }
+    if (st.st_size > rc_offset)
+        rc_offset = replay_aliases(fd, rc_offset, &rc_records);
+}
+
+void alias_journal_loaded(const char *rc_file, const struct stat *st,
+                          long offset, int records) {
+    rc_dev = st ? st->st_dev : 0;
+    rc_ino = st ? st->st_ino : 0;
+    rc_offset = offset;
+    rc_records = records;
+    rc_dirty = 0;
+    if (journal_bloated()) save_aliases(rc_file);
+}
+
+void journal_alias(const char *rc_file, const char *name, const char *value) {
+    size_t len = strlen(name) + (value ? strlen(value) : 0) + 16;
+    char *record = malloc(len);
+    if (!record) {
+        rc_dirty = 1;
+        return;
+    }
+    if (value)
+        len = (size_t)snprintf(record, len, "alias %s:{%s}\n", name, value);
+    else
+        len = (size_t)snprintf(record, len, "unalias %s\n", name);
+
+    int fd = open_locked(rc_file);
+    if (fd < 0) {
+        rc_dirty = 1;
+        free(record);
+        return;
+    }
+
+    /* Take in the other shells' records first, then append ours. The
+     * offset only moves past our record when everything before it was
+     * replayed; otherwise it is replayed later with the rest. */
+    catch_up(fd);
+    struct stat st;
+    off_t before = (fstat(fd, &st) == 0) ? st.st_size : -1;
+    if (write(fd, record, len) == (ssize_t)len) {
+        if (before == (off_t)rc_offset) rc_offset += (long)len;
+        rc_records++;
+    } else {
+        rc_dirty = 1;
+    }
+    lock_rc(fd, 0);
+    close(fd);
+    free(record);
+
+    if (journal_bloated()) save_aliases(rc_file);
+}
+
+/* Compact the journal into one record per alias. The snapshot is
+ * written to a temp file and renamed over the rc file, so a crash never
+ * leaves a half-written rc behind. */
 void save_aliases(const char *rc_file) {
-    FILE *f = fopen(rc_file, "w");
+    int fd = open_locked(rc_file);
+    if (fd < 0) return;
+    catch_up(fd);
+
+    size_t tmp_len = strlen(rc_file) + 32;
+    char *tmp = malloc(tmp_len);
+    FILE *f = NULL;
+    if (tmp) {
+        snprintf(tmp, tmp_len, "%s.tmp.%d", rc_file, (int)getpid());
+        f = fopen(tmp, "w");
+    }
     if (!f) {
         /* Same reasoning as history: if the config file cannot be
          * created (e.g. read-only FS), just skip saving aliases. */
+        free(tmp);
+        lock_rc(fd, 0);
+        close(fd);
         return;
     }
 
-    fprintf(f,
-            "# .qnrc\n"
-            "# Quantis RC file\n\n"
-            "# This file is used for storing created aliases.\n"
-            "# It is not recommended to manually change the contents of this file.\n\n"
-            "# Use the builtin alias and unalias commands to modify your aliases.\n\n");
+    fputs(ALIAS_RC_HEADER, f);
     for (int i = 0; i < alias_count; i++) {
         fprintf(f, "alias %s:{%s}\n",
                 aliases[i].name, aliases[i].value);
     }
-    fclose(f);
+    long end = ftell(f);
+    int failed = ferror(f);
+    if (fclose(f) != 0) failed = 1;
+
+    /* Shells waiting on the old file's lock see the rename once they
+     * get it and move to the new file. */
+    struct stat st;
+    if (failed || stat(tmp, &st) != 0 || rename(tmp, rc_file) != 0) {
+        unlink(tmp);
+    } else {
+        rc_dev = st.st_dev;
+        rc_ino = st.st_ino;
+        rc_offset = end;
+        rc_records = alias_count;
+        rc_dirty = 0;
+    }
+    lock_rc(fd, 0);
+    close(fd);
+    free(tmp);
+}
+
+void flush_aliases(const char *rc_file) {
+    if (rc_dirty || journal_bloated()) save_aliases(rc_file);
 }
@@ -0,0 +1,61 @@
+#include "quantis.h"
+
+#define ARENA_CHUNK 4096
+
+void arena_init(arena_t *a) {
+    a->head = NULL;
+}
+
+void *arena_alloc(arena_t *a, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    arena_chunk_t *c = a->head;
+    if (!c || c->size - c->used < size) {
+        size_t chunk_size = size > ARENA_CHUNK ? size : ARENA_CHUNK;
+        c = malloc(sizeof(arena_chunk_t) + chunk_size);
+        if (!c) return NULL;
+        c->size = chunk_size;
+        c->used = 0;
+        c->next = a->head;
+        a->head = c;
+    }
+
+    void *p = c->data + c->used;
+    c->used += size;
+    return p;
+}
+
+char *arena_strndup(arena_t *a, const char *s, size_t len) {
+    char *copy = arena_alloc(a, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+/* Keep one ordinary chunk for the next line; oversized ones and any
+ * extra chunks a long line needed are given back. */
+void arena_reset(arena_t *a) {
+    arena_chunk_t *keep = NULL;
+    while (a->head) {
+        arena_chunk_t *c = a->head;
+        a->head = c->next;
+        if (!keep && c->size == ARENA_CHUNK)
+            keep = c;
+        else
+            free(c);
+    }
+    if (keep) {
+        keep->next = NULL;
+        keep->used = 0;
+    }
+    a->head = keep;
+}
+
+void arena_free(arena_t *a) {
+    while (a->head) {
+        arena_chunk_t *next = a->head->next;
+        free(a->head);
+        a->head = next;
+    }
+}
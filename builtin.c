@@ -1,5 +1,19 @@
 #include "quantis.h"
 
+static const char *builtin_names[] = {
+    "exit", "cd", "clear", "help", "history", "rehash", "hash", "alias",
+    "unalias", "jobs", "fg", "bg", "wait", "kill", NULL
+};
+
+int is_builtin(const char *name) {
+    for (int i = 0; builtin_names[i]; i++) {
+        if (!strcmp(name, builtin_names[i])) return 1;
+    }
+    return 0;
+}
+
+/* Builtins report failure through last_status, which the caller
+ * clears first. */
 int handle_builtin(char **argv, char *rc_file, char *hist_file) {
     (void)hist_file;
     if (!argv[0]) return 1;
@@ -23,6 +37,51 @@ int handle_builtin(char **argv, char *rc_file, char *hist_file) {
         print_help();
         return 1;
     }
+    if (!strcmp(argv[0], "history")) {
+        if (!argv[1]) {
+            int n = 0;
+            for (int i = 0; i < history.count; i++) {
+                size_t len;
+                const char *line = history_get(i, &len);
+                if (line) printf("%5d  %.*s\n", ++n, (int)len, line);
+            }
+        } else if (!strcmp(argv[1], "-c")) {
+            history_clear();
+        } else if (!strcmp(argv[1], "-s") && argv[2] && atoi(argv[2]) > 0) {
+            history_set_capacity(atoi(argv[2]));
+        } else {
+            fprintf(stderr,
+                    " Quantis: history: Usage: history [-c | -s size]\n");
+            last_status = 2;
+        }
+        return 1;
+    }
+    if (!strcmp(argv[0], "rehash")) {
+        completion_lock();
+        path_index_rehash();
+        completion_unlock();
+        cmd_hash_clear();
+        return 1;
+    }
+    if (!strcmp(argv[0], "hash")) {
+        if (!argv[1]) {
+            cmd_hash_list();
+        } else if (!strcmp(argv[1], "-r")) {
+            cmd_hash_clear();
+        } else if (!strcmp(argv[1], "-d")) {
+            for (int i = 2; argv[i]; i++)
+                cmd_hash_forget(argv[i]);
+        } else {
+            for (int i = 1; argv[i]; i++) {
+                if (!cmd_hash_add(argv[i])) {
+                    fprintf(stderr,
+                            " Quantis: hash: %s: not found\n", argv[i]);
+                    last_status = 1;
+                }
+            }
+        }
+        return 1;
+    }
     if (!strcmp(argv[0], "alias")) {
         if (!argv[1]) {
             for (int i = 0; i < alias_count; i++) {
@@ -57,6 +116,7 @@ int handle_builtin(char **argv, char *rc_file, char *hist_file) {
                 fprintf(stderr,
                         " Quantis: alias: "
                         "Usage: alias name:{alias name}\n");
+                last_status = 2;
                 free(alias_def);
                 return 1;
             }
@@ -73,12 +133,15 @@ int handle_builtin(char **argv, char *rc_file, char *hist_file) {
             char *value = extract_alias_value(colon + 1);
 
             if (strlen(name) > 0 && value) {
-                add_alias(name, value);
-                save_aliases(rc_file);
+                if (add_alias(name, value))
+                    journal_alias(rc_file, name, value);
+                else
+                    last_status = 1;
             } else {
                 fprintf(stderr,
                         " Quantis: alias: "
                         "Invalid value extraction.\n");
+                last_status = 1;
             }
 
             if (value) free(value);
@@ -90,11 +153,37 @@ int handle_builtin(char **argv, char *rc_file, char *hist_file) {
         if (!argv[1]) {
             fprintf(stderr,
                     " Quantis: unalias: Usage: unalias name\n");
+            last_status = 2;
         } else {
-            remove_alias(argv[1]);
-            save_aliases(rc_file);
+            /* argv may point into the alias being removed. */
+            char *name = strdup(argv[1]);
+            if (name && find_alias(name)) {
+                remove_alias(name);
+                journal_alias(rc_file, name, NULL);
+            }
+            free(name);
         }
         return 1;
     }
+    if (!strcmp(argv[0], "jobs")) {
+        jobs_list();
+        return 1;
+    }
+    if (!strcmp(argv[0], "fg")) {
+        job_foreground(argv[1]);
+        return 1;
+    }
+    if (!strcmp(argv[0], "bg")) {
+        job_background(argv[1]);
+        return 1;
+    }
+    if (!strcmp(argv[0], "wait")) {
+        jobs_wait(argv);
+        return 1;
+    }
+    if (!strcmp(argv[0], "kill")) {
+        jobs_kill(argv);
+        return 1;
+    }
     return 0;
 }
@@ -0,0 +1,161 @@
+#include "quantis.h"
+
+typedef struct {
+    char *name;
+    char *path;
+    int hits;
+} cmd_hash_entry_t;
+
+static cmd_hash_entry_t *table = NULL;
+static size_t table_cap = 0;
+static size_t table_used = 0;
+static char *table_path = NULL;
+
+static size_t find_slot(const char *name) {
+    size_t mask = table_cap - 1;
+    size_t i = hash_string(name) & mask;
+    while (table[i].name && strcmp(table[i].name, name) != 0)
+        i = (i + 1) & mask;
+    return i;
+}
+
+static int grow_table(void) {
+    size_t old_cap = table_cap;
+    cmd_hash_entry_t *old = table;
+
+    size_t new_cap = old_cap ? old_cap * 2 : 64;
+    cmd_hash_entry_t *grown = calloc(new_cap, sizeof(*grown));
+    if (!grown) return 0;
+
+    table = grown;
+    table_cap = new_cap;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i].name) table[find_slot(old[i].name)] = old[i];
+    }
+    free(old);
+    return 1;
+}
+
+/* Drop the table if $PATH changed since it was filled. */
+static void check_path(void) {
+    const char *path_env = getenv("PATH");
+    if (!path_env) path_env = "";
+    if (table_path && strcmp(table_path, path_env) == 0) return;
+
+    cmd_hash_clear();
+    free(table_path);
+    table_path = strdup(path_env);
+}
+
+static char *search_path(const char *name) {
+    const char *path_env = getenv("PATH");
+    if (!path_env || !*path_env) return NULL;
+
+    char *found = NULL;
+    for (const char *p = path_env; p && !found;) {
+        char dir[PATH_BUF];
+        p = path_next(p, dir, sizeof(dir));
+        char full_path[PATH_BUF * 2];
+        snprintf(full_path, sizeof(full_path), "%s/%s", dir, name);
+        if (is_executable(full_path)) found = strdup(full_path);
+    }
+    return found;
+}
+
+static cmd_hash_entry_t *insert(const char *name, char *path) {
+    if ((table_used + 1) * 4 > table_cap * 3 && !grow_table()) {
+        free(path);
+        return NULL;
+    }
+
+    cmd_hash_entry_t *e = &table[find_slot(name)];
+    if (e->name) {
+        free(e->path);
+    } else {
+        e->name = strdup(name);
+        e->hits = 0;
+        table_used++;
+    }
+    e->path = path;
+    return e;
+}
+
+const char *cmd_hash_resolve(const char *name) {
+    check_path();
+
+    if (table_cap) {
+        cmd_hash_entry_t *e = &table[find_slot(name)];
+        if (e->name) {
+            e->hits++;
+            return e->path;
+        }
+    }
+
+    char *path = search_path(name);
+    if (!path) return NULL;
+
+    cmd_hash_entry_t *e = insert(name, path);
+    if (!e) return NULL;
+    e->hits++;
+    return e->path;
+}
+
+int cmd_hash_add(const char *name) {
+    check_path();
+
+    char *path = search_path(name);
+    if (!path) return 0;
+    return insert(name, path) != NULL;
+}
+
+void cmd_hash_forget(const char *name) {
+    if (!table_cap) return;
+
+    size_t mask = table_cap - 1;
+    size_t i = find_slot(name);
+    if (!table[i].name) return;
+
+    free(table[i].name);
+    free(table[i].path);
+    table[i].name = NULL;
+    table_used--;
+
+    /* Backward-shift the rest of the probe run so lookups never
+     * stop early at the hole. */
+    size_t j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (!table[j].name) break;
+        size_t home = hash_string(table[j].name) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            table[i] = table[j];
+            table[j].name = NULL;
+            i = j;
+        }
+    }
+}
+
+void cmd_hash_clear(void) {
+    for (size_t i = 0; i < table_cap; i++) {
+        if (table[i].name) {
+            free(table[i].name);
+            free(table[i].path);
+        }
+    }
+    free(table);
+    table = NULL;
+    table_cap = 0;
+    table_used = 0;
+}
+
+void cmd_hash_list(void) {
+    if (table_used == 0) {
+        printf(" Quantis: hash: hash table empty\n");
+        return;
+    }
+    printf("hits\tcommand\n");
+    for (size_t i = 0; i < table_cap; i++) {
+        if (table[i].name)
+            printf("%4d\t%s\n", table[i].hits, table[i].path);
+    }
+}
@@ -1,90 +1,61 @@
 #include "quantis.h"
 
-int handle_tab_completion(char *line_buffer, int *len) {
-    if (*len == 0) return 0;
+int handle_tab_completion(linebuf_t *lb) {
+    if (lb->gap_start == 0) return 0;
 
-    char temp_line[MAX_LINE];
-    strncpy(temp_line, line_buffer, *len);
-    temp_line[*len] = '\0';
+    /* Complete the word that ends at the cursor. */
+    const char *temp_line = lb_before_cursor(lb);
+    if (!temp_line) return 0;
 
-    char *last_space = strrchr(temp_line, ' ');
-    char *word_start = last_space ? (last_space + 1) : temp_line;
+    const char *last_space = strrchr(temp_line, ' ');
+    const char *word_start = last_space ? (last_space + 1) : temp_line;
     int word_pos = (int)(word_start - temp_line);
+    size_t word_len = strlen(word_start);
 
-    char *completions[MAX_COMPLETIONS];
-    int comp_count = 0;
+    comp_set_t set;
+    comp_init(&set);
 
+    completion_lock();
     if (word_pos == 0) {
-        comp_count = find_executables_in_path(
-            word_start, completions, MAX_COMPLETIONS);
+        find_executables_in_path(word_start, &set);
     } else {
-        comp_count = find_file_completions(
-            word_start, completions, MAX_COMPLETIONS);
+        find_file_completions(word_start, &set);
     }
+    completion_unlock();
 
-    if (comp_count == 0) {
-        return 0;
-    }
-
-    qsort(completions, comp_count,
-          sizeof(char *), compare_strings);
-
-    if (comp_count == 1) {
-        int old_word_len = (int)strlen(word_start);
-        int new_word_len = (int)strlen(completions[0]);
-
-        for (int i = 0; i < old_word_len; i++) {
-            write(STDOUT_FILENO, "\b \b", 3);
-        }
+    comp_finish(&set);
+    int comp_count = set.count;
+    size_t common_len = set.common_len;
+    char **completions = set.items;
+    int result = 1;
 
-        strcpy(line_buffer + word_pos, completions[0]);
-        *len = word_pos + new_word_len;
-        line_buffer[*len] = '\0';
-
-        write(STDOUT_FILENO,
-              completions[0], new_word_len);
-
-        free(completions[0]);
-        return 1;
-    }
-
-    size_t common_len = strlen(completions[0]);
-    for (int i = 1; i < comp_count; i++) {
-        size_t j = 0;
-        while (j < common_len &&
-               completions[0][j] == completions[i][j]) {
-            j++;
-        }
-        common_len = j;
-    }
-
-    if (common_len > strlen(word_start)) {
-        int old_word_len = (int)strlen(word_start);
-
-        for (int i = 0; i < old_word_len; i++) {
-            write(STDOUT_FILENO, "\b \b", 3);
-        }
-
-        strncpy(line_buffer + word_pos,
-                completions[0], common_len);
-        *len = word_pos + (int)common_len;
-        line_buffer[*len] = '\0';
-
-        write(STDOUT_FILENO,
-              line_buffer + word_pos, common_len);
+    if (comp_count == 0) {
+        result = 0;
+    } else if (comp_count == 1) {
+        lb_delete_back(lb, word_len);
+        lb_insert(lb, completions[0], strlen(completions[0]));
+    } else if (common_len > word_len) {
+        lb_delete_back(lb, word_len);
+        lb_insert(lb, completions[0], common_len);
     } else {
-        printf("\n" FG_GRAY " " COL_RESET " ");
-        for (int i = 0; i < comp_count; i++) {
-            printf("%s  ", completions[i]);
+        /* Every candidate is in the arena back to back, so the list
+         * needs at most its size plus the separators. */
+        size_t list_len = sizeof(FG_GRAY " " COL_RESET " \n") +
+                          set.arena_len + comp_count * 2;
+
+        char *list = malloc(list_len);
+        if (list) {
+            char *p = list;
+            p += sprintf(p, FG_GRAY " " COL_RESET " ");
+            for (int i = 0; i < comp_count; i++)
+                p += sprintf(p, "%s  ", completions[i]);
+            strcpy(p, "\n");
+            render_message(list);
+            free(list);
         }
-        printf("\n");
+        result = 2;
     }
 
-    for (int i = 0; i < comp_count; i++) {
-        free(completions[i]);
-    }
-
-    return (comp_count > 1 &&
-            common_len <= strlen(word_start)) ? 2 : 1;
+    comp_free(&set);
+    return result;
 }
-
@@ -8,50 +8,30 @@ int is_executable(const char *path) {
     return 0;
 }
 
-int find_executables_in_path(const char *prefix,
-                             char **completions,
-                             int max_comp) {
-    int count = 0;
-    char *path_env = getenv("PATH");
-    if (!path_env) return 0;
-
-    char *path_copy = strdup(path_env);
-    char *dir = strtok(path_copy, ":");
-    size_t prefix_len = strlen(prefix);
-
-    while (dir && count < max_comp) {
-        DIR *d = opendir(dir);
-        if (!d) {
-            dir = strtok(NULL, ":");
-            continue;
+int find_executables_in_path(const char *prefix, comp_set_t *set) {
+    char **names;
+    int added = 0;
+
+    /* Fuzzy mode scores the whole index, skipping names that lack
+     * one of the query's characters without looking at them. */
+    if (fuzzy_enabled() && *prefix) {
+        size_t prefix_len = strlen(prefix);
+        char_mask_t want = fuzzy_mask(prefix, prefix_len);
+        const char_mask_t *masks = NULL;
+        int count = path_index_lookup("", &names, &masks);
+        for (int i = 0; i < count; i++) {
+            if (masks && (masks[i] & want) != want) continue;
+            int score = fuzzy_score(prefix, prefix_len, names[i],
+                                    strlen(names[i]));
+            if (score != FUZZY_NO_MATCH)
+                added += comp_add_scored(set, "", 0, names[i], score);
         }
-
-        struct dirent *entry;
-        while ((entry = readdir(d)) && count < max_comp) {
-            if (strncmp(entry->d_name, prefix, prefix_len) == 0) {
-                char full_path[PATH_BUF];
-                snprintf(full_path, sizeof(full_path), "%s/%s",
-                         dir, entry->d_name);
-
-                if (is_executable(full_path)) {
-                    int already_added = 0;
-                    for (int i = 0; i < count; i++) {
-                        if (strcmp(completions[i], entry->d_name) == 0) {
-                            already_added = 1;
-                            break;
-                        }
-                    }
-                    if (!already_added) {
-                        completions[count++] = strdup(entry->d_name);
-                    }
-                }
-            }
-        }
-        closedir(d);
-        dir = strtok(NULL, ":");
+        return added;
     }
 
-    free(path_copy);
-    return count;
+    int count = path_index_lookup(prefix, &names, NULL);
+    for (int i = 0; i < count; i++) {
+        added += comp_add(set, "", 0, names[i]);
+    }
+    return added;
 }
-
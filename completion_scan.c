@@ -1,54 +1,67 @@
 #include "quantis.h"
 
-int find_file_completions(const char *prefix,
-                          char **completions,
-                          int max_comp) {
-    int count = 0;
-    char *expanded = expand_tilde(prefix);
-    char *last_slash = strrchr(expanded, '/');
-
-    char *dir_path = NULL;
-    char *file_prefix = NULL;
-    int has_slash = (last_slash != NULL);
-
-    if (last_slash) {
-        *last_slash = '\0';
-        dir_path = (*expanded == '\0') ? "/" : expanded;
-        file_prefix = last_slash + 1;
-    } else {
-        dir_path = ".";
-        file_prefix = expanded;
+/* Split a file word into the directory to list and the name prefix
+ * within it. Only a leading ~ is expanded; *expanded receives the
+ * malloc'd expansion, if any, which the returned prefix points into.
+ * Returns NULL for a bare ~user, which names no directory yet. */
+const char *completion_dir(const char *word, char *dir_path, size_t size,
+                           char **expanded) {
+    *expanded = NULL;
+    if (word[0] == '~') {
+        if (!strchr(word, '/')) return NULL;
+        *expanded = expand_tilde(word);
+        if (!*expanded) return NULL;
     }
+    const char *path = *expanded ? *expanded : word;
+    const char *last_slash = strrchr(path, '/');
 
-    DIR *d = opendir(dir_path);
-    if (!d) {
-        free(expanded);
-        return 0;
+    if (!last_slash) {
+        snprintf(dir_path, size, ".");
+        return path;
     }
+    if (last_slash == path)
+        snprintf(dir_path, size, "/");
+    else
+        snprintf(dir_path, size, "%.*s", (int)(last_slash - path), path);
+    return last_slash + 1;
+}
 
-    size_t prefix_len = strlen(file_prefix);
-    struct dirent *entry;
+int find_file_completions(const char *prefix, comp_set_t *set) {
+    char dir_path[PATH_BUF];
+    char *expanded;
+    const char *file_prefix =
+        completion_dir(prefix, dir_path, sizeof(dir_path), &expanded);
+    if (!file_prefix) return 0;
+    int has_slash = strchr(prefix, '/') != NULL;
 
-    while ((entry = readdir(d)) && count < max_comp) {
-        if (entry->d_name[0] == '.' && file_prefix[0] != '.')
-            continue;
+    int fuzzy = fuzzy_enabled() && *file_prefix;
+    size_t file_prefix_len = strlen(file_prefix);
+
+    char **names;
+    const char_mask_t *masks = NULL;
+    char_mask_t want = fuzzy ? fuzzy_mask(file_prefix, file_prefix_len) : 0;
+    int found = dircache_lookup(dir_path, fuzzy ? "" : file_prefix, &names,
+                                &masks);
 
-        if (strncmp(entry->d_name, file_prefix, prefix_len) == 0) {
-            if (has_slash) {
-                size_t total_len = strlen(prefix) - prefix_len
-                                 + strlen(entry->d_name) + 1;
-                char *full = malloc(total_len);
-                snprintf(full, total_len, "%.*s%s",
-                         (int)(strlen(prefix) - prefix_len),
-                         prefix, entry->d_name);
-                completions[count++] = full;
-            } else {
-                completions[count++] = strdup(entry->d_name);
-            }
+    /* Candidates keep the directory part as the user typed it. */
+    size_t lead_len = has_slash ? strlen(prefix) - file_prefix_len : 0;
+    int count = 0;
+
+    for (int i = 0; i < found; i++) {
+        if (names[i][0] == '.' && file_prefix[0] != '.')
+            continue;
+        if (!fuzzy) {
+            count += comp_add(set, prefix, lead_len, names[i]);
+            continue;
         }
+        if (masks && (masks[i] & want) != want) continue;
+        int score = fuzzy_score(file_prefix, file_prefix_len, names[i],
+                                strlen(names[i]));
+        if (score != FUZZY_NO_MATCH)
+            count += comp_add_scored(set, prefix, lead_len, names[i],
+                                     score);
     }
 
-    closedir(d);
     free(expanded);
     return count;
 }
@@ -0,0 +1,170 @@
+#include "quantis.h"
+
+/* Candidates for one Tab press. Their text lives back to back in one
+ * arena, a hash set of indexes drops repeats as they are added, and
+ * comp_finish sorts once and works out the shared prefix. Fuzzy
+ * matches carry a score and are ranked by it instead. */
+
+typedef struct {
+    char *text;
+    int score;
+    size_t len;
+} comp_rank_t;
+
+void comp_init(comp_set_t *set) {
+    memset(set, 0, sizeof(*set));
+}
+
+void comp_free(comp_set_t *set) {
+    free(set->arena);
+    free(set->offsets);
+    free(set->scores);
+    free(set->slots);
+    free(set->items);
+    comp_init(set);
+}
+
+static int reserve_arena(comp_set_t *set, size_t need) {
+    if (set->arena_len + need <= set->arena_cap) return 1;
+    size_t new_cap = set->arena_cap ? set->arena_cap * 2 : 4096;
+    while (new_cap < set->arena_len + need) new_cap *= 2;
+    char *grown = realloc(set->arena, new_cap);
+    if (!grown) return 0;
+    set->arena = grown;
+    set->arena_cap = new_cap;
+    return 1;
+}
+
+static int grow_slots(comp_set_t *set) {
+    size_t new_cap = set->slot_cap ? set->slot_cap * 2 : 256;
+    int *slots = calloc(new_cap, sizeof(int));
+    if (!slots) return 0;
+
+    for (int i = 0; i < set->count; i++) {
+        const char *s = set->arena + set->offsets[i];
+        size_t j = hash_string(s) & (new_cap - 1);
+        while (slots[j]) j = (j + 1) & (new_cap - 1);
+        slots[j] = i + 1;
+    }
+    free(set->slots);
+    set->slots = slots;
+    set->slot_cap = new_cap;
+    return 1;
+}
+
+/* Add lead followed by name, unless the set already holds it; a repeat
+ * keeps the better score. */
+static int add_candidate(comp_set_t *set, const char *lead, size_t lead_len,
+                         const char *name, int score, int ranked) {
+    size_t name_len = strlen(name);
+    if (!reserve_arena(set, lead_len + name_len + 1)) return 0;
+    if ((size_t)(set->count + 1) * 2 > set->slot_cap && !grow_slots(set))
+        return 0;
+    if (set->count == set->offsets_cap) {
+        int new_cap = set->offsets_cap ? set->offsets_cap * 2 : 64;
+        size_t *grown = realloc(set->offsets, new_cap * sizeof(size_t));
+        if (!grown) return 0;
+        set->offsets = grown;
+        int *scores = realloc(set->scores, new_cap * sizeof(int));
+        if (!scores) return 0;
+        set->scores = scores;
+        set->offsets_cap = new_cap;
+    }
+
+    /* Build the candidate in place; it only stays if it is new. */
+    char *s = set->arena + set->arena_len;
+    memcpy(s, lead, lead_len);
+    memcpy(s + lead_len, name, name_len + 1);
+
+    size_t mask = set->slot_cap - 1;
+    size_t j = hash_bytes(s, lead_len + name_len) & mask;
+    while (set->slots[j]) {
+        int k = set->slots[j] - 1;
+        if (strcmp(set->arena + set->offsets[k], s) == 0) {
+            if (score > set->scores[k]) set->scores[k] = score;
+            return 0;
+        }
+        j = (j + 1) & mask;
+    }
+
+    if (ranked) set->ranked = 1;
+    set->scores[set->count] = score;
+    set->offsets[set->count] = set->arena_len;
+    set->slots[j] = ++set->count;
+    set->arena_len += lead_len + name_len + 1;
+    return 1;
+}
+
+/* Any score, zero and negative ones included, ranks the set. */
+int comp_add_scored(comp_set_t *set, const char *lead, size_t lead_len,
+                    const char *name, int score) {
+    return add_candidate(set, lead, lead_len, name, score, 1);
+}
+
+int comp_add(comp_set_t *set, const char *lead, size_t lead_len,
+             const char *name) {
+    return add_candidate(set, lead, lead_len, name, 0, 0);
+}
+
+/* Best score first, then the shorter candidate, then by name. */
+static int compare_rank(const void *a, const void *b) {
+    const comp_rank_t *x = a;
+    const comp_rank_t *y = b;
+    if (x->score != y->score) return x->score > y->score ? -1 : 1;
+    if (x->len != y->len) return x->len < y->len ? -1 : 1;
+    return strcmp(x->text, y->text);
+}
+
+static void rank_items(comp_set_t *set) {
+    comp_rank_t *ranks = malloc(set->count * sizeof(comp_rank_t));
+    if (!ranks) {
+        qsort(set->items, set->count, sizeof(char *), compare_strings);
+        return;
+    }
+    for (int i = 0; i < set->count; i++) {
+        ranks[i].text = set->arena + set->offsets[i];
+        ranks[i].score = set->scores[i];
+        ranks[i].len = strlen(ranks[i].text);
+    }
+    qsort(ranks, set->count, sizeof(comp_rank_t), compare_rank);
+    for (int i = 0; i < set->count; i++) set->items[i] = ranks[i].text;
+    free(ranks);
+}
+
+/* Sorted view of the candidates, and the length of their common
+ * prefix. */
+void comp_finish(comp_set_t *set) {
+    free(set->items);
+    set->items = NULL;
+    set->common_len = 0;
+    if (set->count == 0) return;
+
+    set->items = malloc(set->count * sizeof(char *));
+    if (!set->items) {
+        set->count = 0;
+        return;
+    }
+    for (int i = 0; i < set->count; i++)
+        set->items[i] = set->arena + set->offsets[i];
+
+    if (set->ranked) {
+        rank_items(set);
+        size_t n = strlen(set->items[0]);
+        for (int i = 1; i < set->count && n > 0; i++) {
+            size_t k = 0;
+            while (k < n && set->items[0][k] == set->items[i][k]) k++;
+            n = k;
+        }
+        set->common_len = n;
+        return;
+    }
+
+    qsort(set->items, set->count, sizeof(char *), compare_strings);
+
+    /* Sorted, the first and last share the prefix all of them share. */
+    const char *first = set->items[0];
+    const char *last = set->items[set->count - 1];
+    size_t n = 0;
+    while (first[n] && first[n] == last[n]) n++;
+    set->common_len = n;
+}
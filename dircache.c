@@ -0,0 +1,215 @@
+#include "quantis.h"
+
+/* Listings of directories that file completion has looked into, kept
+ * sorted so a prefix is a binary search. A listing is reused while the
+ * directory's device, inode and mtime are unchanged, and the least
+ * recently used ones are dropped once the cache outgrows its budget. */
+
+typedef struct dir_listing {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    time_t mtime;
+    char *blob;     /* every name, NUL-separated, in one block */
+    char **names;   /* sorted pointers into blob */
+    char_mask_t *masks;  /* fuzzy_mask of each name */
+    int count;
+    size_t bytes;
+    struct dir_listing *prev;
+    struct dir_listing *next;
+} dir_listing_t;
+
+static dir_listing_t *lru_head = NULL;  /* most recently used */
+static dir_listing_t *lru_tail = NULL;
+static size_t cache_bytes = 0;
+
+/* Set while the precompute worker fills the cache; see dircache_warm. */
+static int (*scan_stop)(void) = NULL;
+
+static void unlink_listing(dir_listing_t *d) {
+    if (d->prev) d->prev->next = d->next;
+    else lru_head = d->next;
+    if (d->next) d->next->prev = d->prev;
+    else lru_tail = d->prev;
+    d->prev = d->next = NULL;
+}
+
+static void push_front(dir_listing_t *d) {
+    d->next = lru_head;
+    d->prev = NULL;
+    if (lru_head) lru_head->prev = d;
+    lru_head = d;
+    if (!lru_tail) lru_tail = d;
+}
+
+static void free_listing(dir_listing_t *d) {
+    unlink_listing(d);
+    cache_bytes -= d->bytes;
+    free(d->path);
+    free(d->blob);
+    free(d->names);
+    free(d->masks);
+    free(d);
+}
+
+/* Read the directory into d, replacing what it held. */
+static int scan_listing(dir_listing_t *d, const struct stat *st) {
+    DIR *dir = opendir(d->path);
+    if (!dir) return 0;
+
+    char *blob = NULL;
+    size_t blob_len = 0, blob_cap = 0;
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (scan_stop && scan_stop()) {
+            closedir(dir);
+            free(blob);
+            return 0;
+        }
+        size_t len = strlen(entry->d_name) + 1;
+        if (blob_len + len > blob_cap) {
+            size_t new_cap = blob_cap ? blob_cap * 2 : 4096;
+            while (new_cap < blob_len + len) new_cap *= 2;
+            char *grown = realloc(blob, new_cap);
+            if (!grown) break;
+            blob = grown;
+            blob_cap = new_cap;
+        }
+        memcpy(blob + blob_len, entry->d_name, len);
+        blob_len += len;
+        count++;
+    }
+    closedir(dir);
+
+    char **names = malloc((count ? count : 1) * sizeof(char *));
+    if (!names) {
+        free(blob);
+        return 0;
+    }
+    char *p = blob;
+    for (int i = 0; i < count; i++) {
+        names[i] = p;
+        p += strlen(p) + 1;
+    }
+    qsort(names, count, sizeof(char *), compare_strings);
+
+    char_mask_t *masks = malloc((count ? count : 1) * sizeof(char_mask_t));
+    for (int i = 0; masks && i < count; i++)
+        masks[i] = fuzzy_mask(names[i], strlen(names[i]));
+
+    cache_bytes -= d->bytes;
+    free(d->blob);
+    free(d->names);
+    free(d->masks);
+    d->blob = blob;
+    d->names = names;
+    d->masks = masks;
+    d->count = count;
+    d->bytes = blob_len + count * (sizeof(char *) + sizeof(char_mask_t)) +
+               strlen(d->path) + 1 + sizeof(*d);
+    cache_bytes += d->bytes;
+
+    d->dev = st->st_dev;
+    d->ino = st->st_ino;
+    /* Same rule as the PATH index: a listing taken in the second the
+     * directory last changed is rescanned next time. */
+    d->mtime = (st->st_mtime >= time(NULL)) ? (time_t)-1 : st->st_mtime;
+    return 1;
+}
+
+static void enforce_budget(const dir_listing_t *keep) {
+    while (cache_bytes > DIRCACHE_BUDGET && lru_tail && lru_tail != keep)
+        free_listing(lru_tail);
+}
+
+static dir_listing_t *get_listing(const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) return NULL;
+
+    dir_listing_t *d = lru_head;
+    while (d && strcmp(d->path, path) != 0) d = d->next;
+
+    if (d && d->dev == st.st_dev && d->ino == st.st_ino &&
+        d->mtime != (time_t)-1 && d->mtime == st.st_mtime) {
+        unlink_listing(d);
+        push_front(d);
+        return d;
+    }
+
+    if (!d) {
+        d = calloc(1, sizeof(dir_listing_t));
+        if (!d) return NULL;
+        d->path = strdup(path);
+        if (!d->path) {
+            free(d);
+            return NULL;
+        }
+    } else {
+        unlink_listing(d);
+    }
+    push_front(d);
+
+    if (!scan_listing(d, &st)) {
+        free_listing(d);
+        return NULL;
+    }
+    enforce_budget(d);
+    return d;
+}
+
+/* Listings are keyed by absolute path, so the worker, which is handed
+ * one, and a Tab in the same directory share them. */
+const char *dircache_absolute(const char *dir, char *buf, size_t size) {
+    if (dir[0] == '/') return dir;
+    char cwd[PATH_BUF];
+    if (!getcwd(cwd, sizeof(cwd))) return dir;
+    if (strcmp(dir, ".") == 0) snprintf(buf, size, "%s", cwd);
+    else snprintf(buf, size, "%s/%s", strcmp(cwd, "/") ? cwd : "", dir);
+    return buf;
+}
+
+/* Names in dir that start with prefix, and their masks when masks is
+ * given. Both point into the cache and stay valid until the next
+ * dircache call. */
+int dircache_lookup(const char *dir, const char *prefix, char ***first,
+                    const char_mask_t **masks) {
+    char path[PATH_BUF];
+    dir_listing_t *d = get_listing(dircache_absolute(dir, path,
+                                                     sizeof(path)));
+    if (!d) return 0;
+
+    size_t prefix_len = strlen(prefix);
+    int lo = 0, hi = d->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strncmp(d->names[mid], prefix, prefix_len) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    int start = lo;
+    hi = d->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strncmp(d->names[mid], prefix, prefix_len) <= 0) lo = mid + 1;
+        else hi = mid;
+    }
+
+    *first = d->names + start;
+    if (masks) *masks = d->masks ? d->masks + start : NULL;
+    return lo - start;
+}
+
+/* Load the listing of the absolute path dir, giving up when stop
+ * returns true; returns 0 if it did. A listing cut short is dropped
+ * rather than cached. */
+int dircache_warm(const char *dir, int (*stop)(void)) {
+    scan_stop = stop;
+    get_listing(dir);
+    int done = !stop();
+    scan_stop = NULL;
+    return done;
+}
+
+void dircache_clear(void) {
+    while (lru_head) free_listing(lru_head);
+}
@@ -0,0 +1,166 @@
+#include "quantis.h"
+
+/* Walk a parsed command list, honouring && and ||, and run each
+ * pipeline with its redirections. A lone builtin runs in the shell
+ * itself; anything else goes to execute_pipeline. */
+
+/* Open the files a command redirects to and describe the dup2 calls
+ * that apply them. Opened descriptors are also listed in opened so the
+ * caller can close them. Returns the number of entries, or -1. */
+static int open_redirs(arena_t *a, const command_t *cmd, fd_map_t *map,
+                       int *opened, int *nopened) {
+    int n = 0;
+    *nopened = 0;
+
+    for (const redir_t *r = cmd->redirs; r; r = r->next) {
+        char *target = expand_word(a, &r->target);
+        if (!target) return -1;
+
+        int src;
+        if (r->kind == REDIR_DUP) {
+            if (*target < '0' || *target > '9') {
+                fprintf(stderr, " Quantis: %s: ambiguous redirect\n",
+                        target);
+                return -1;
+            }
+            src = atoi(target);
+        } else {
+            int flags = O_CLOEXEC;
+            if (r->kind == REDIR_IN)
+                flags |= O_RDONLY;
+            else if (r->kind == REDIR_APPEND)
+                flags |= O_WRONLY | O_CREAT | O_APPEND;
+            else
+                flags |= O_WRONLY | O_CREAT | O_TRUNC;
+
+            src = open(target, flags, 0666);
+            if (src < 0) {
+                fprintf(stderr, " Quantis: %s: %s\n", target,
+                        strerror(errno));
+                return -1;
+            }
+            opened[(*nopened)++] = src;
+        }
+        map[n].fd = r->fd;
+        map[n].src = src;
+        n++;
+    }
+    return n;
+}
+
+/* Builtins run in the shell itself, so their redirections are applied
+ * around the call and undone afterwards. */
+static void run_builtin(char **argv, const fd_map_t *map, int n,
+                        char *rc_file, char *hist_file) {
+    int saved[n > 0 ? n : 1];
+
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = 0; i < n; i++) {
+        saved[i] = fcntl(map[i].fd, F_DUPFD_CLOEXEC, 10);
+        if (dup2(map[i].src, map[i].fd) < 0) {
+            fprintf(stderr, " Quantis: %d: %s\n", map[i].src,
+                    strerror(errno));
+            last_status = 1;
+            n = i + 1;
+            goto restore;
+        }
+    }
+
+    last_status = 0;
+    handle_builtin(argv, rc_file, hist_file);
+
+restore:
+    fflush(stdout);
+    fflush(stderr);
+    for (int i = n - 1; i >= 0; i--) {
+        if (saved[i] >= 0) {
+            dup2(saved[i], map[i].fd);
+            close(saved[i]);
+        } else {
+            close(map[i].fd);
+        }
+    }
+}
+
+/* Expand a command's words, resolve an alias and open its
+ * redirections into st. Returns 0 when a redirection fails. */
+static int prepare_stage(arena_t *a, const command_t *cmd, stage_t *st,
+                         int *bg, int *opened, int *nopened) {
+    int nredirs = 0;
+    for (const redir_t *r = cmd->redirs; r; r = r->next) nredirs++;
+
+    char **argv = arena_alloc(a, (cmd->nwords + 1) * sizeof(char *));
+    fd_map_t *map = arena_alloc(a, (nredirs + 1) * sizeof(fd_map_t));
+    if (!argv || !map) return 0;
+
+    int argc = 0;
+    for (int i = 0; i < cmd->nwords; i++) {
+        argv[argc] = expand_word(a, &cmd->words[i]);
+        if (!argv[argc]) return 0;
+        argc++;
+    }
+    argv[argc] = NULL;
+
+    /* Only a command name typed without quotes or escapes is looked up
+     * as an alias, so "ls" or \ls reaches the real command. */
+    if (argc > 0 && !(cmd->words[0].flags & WORD_EXPAND)) {
+        argv = expand_alias_argv(a, argv, argc, bg);
+        if (!argv) return 0;
+    }
+
+    int count;
+    int n = open_redirs(a, cmd, map, opened + *nopened, &count);
+    *nopened += count;
+    if (n < 0) return 0;
+
+    st->argv = argv;
+    st->redirs = map;
+    st->nredirs = n;
+    return 1;
+}
+
+static void run_pipeline(arena_t *a, const pipeline_t *pl, char *rc_file,
+                         char *hist_file) {
+    int total = 0;
+    for (const command_t *c = pl->first; c; c = c->next)
+        for (const redir_t *r = c->redirs; r; r = r->next) total++;
+
+    stage_t *stages = arena_alloc(a, pl->stages * sizeof(stage_t));
+    int *opened = arena_alloc(a, (total + 1) * sizeof(int));
+    if (!stages || !opened) {
+        last_status = 1;
+        return;
+    }
+
+    int bg = pl->bg;
+    int nopened = 0;
+    int ok = 1;
+    int n = 0;
+    for (const command_t *c = pl->first; c && ok; c = c->next)
+        ok = prepare_stage(a, c, &stages[n++], &bg, opened, &nopened);
+
+    if (!ok)
+        last_status = 1;
+    else if (n == 1 && !stages[0].argv[0])
+        last_status = 0;
+    else if (n == 1 && !bg && is_builtin(stages[0].argv[0]))
+        run_builtin(stages[0].argv, stages[0].redirs, stages[0].nredirs,
+                    rc_file, hist_file);
+    else
+        execute_pipeline(stages, n, bg, pl->source, rc_file, hist_file);
+
+    for (int i = 0; i < nopened; i++) close(opened[i]);
+}
+
+void run_list(arena_t *a, pipeline_t *list, char *rc_file,
+              char *hist_file) {
+    int op = LIST_SEQ;
+
+    for (pipeline_t *pl = list; pl && run; pl = pl->next) {
+        int skip = (op == LIST_AND && last_status != 0) ||
+                   (op == LIST_OR && last_status == 0);
+        op = pl->op;
+        if (!skip) run_pipeline(a, pl, rc_file, hist_file);
+    }
+}
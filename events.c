@@ -0,0 +1,115 @@
+#include "quantis.h"
+#include <poll.h>
+#ifndef __seele__
+#include <sys/signalfd.h>
+#endif
+
+/* The session's single wait point. Terminal input and the signals the
+ * shell acts on (SIGINT, SIGCHLD, SIGWINCH) arrive through one poll:
+ * the signals are blocked and read from a signalfd, or, on seele or
+ * when signalfd is unavailable, a handler that does nothing but write
+ * the signal number to a self-pipe. Children are reaped here; the rest
+ * is handed back to the caller as EV_* bits to act on in normal
+ * context. */
+
+static int sig_fd = -1;      /* the signalfd, or the pipe's read end */
+static int sig_pipe = -1;    /* the pipe's write end, if one is used */
+
+static void signal_to_pipe(int sig) {
+    int saved = errno;
+    unsigned char b = (unsigned char)sig;
+    write(sig_pipe, &b, 1);
+    errno = saved;
+}
+
+static int open_self_pipe(void) {
+    int fds[2];
+    if (pipe(fds) < 0) return 0;
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[i], F_SETFL, O_NONBLOCK);
+    }
+    sig_fd = fds[0];
+    sig_pipe = fds[1];
+    signal(SIGINT, signal_to_pipe);
+    signal(SIGCHLD, signal_to_pipe);
+    signal(SIGWINCH, signal_to_pipe);
+    return 1;
+}
+
+void events_init(void) {
+#ifndef __seele__
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGWINCH);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    sig_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sig_fd >= 0) return;
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+#endif
+    if (!open_self_pipe()) signal(SIGINT, SIG_IGN);
+}
+
+static int signal_event(int sig) {
+    switch (sig) {
+    case SIGINT: return EV_INTERRUPT;
+    case SIGCHLD: return EV_CHILD;
+    case SIGWINCH: return EV_RESIZE;
+    }
+    return 0;
+}
+
+static int read_signals(void) {
+    int events = 0;
+#ifndef __seele__
+    if (sig_pipe < 0) {
+        struct signalfd_siginfo info;
+        while (read(sig_fd, &info, sizeof(info)) == sizeof(info))
+            events |= signal_event((int)info.ssi_signo);
+        return events;
+    }
+#endif
+    unsigned char buf[64];
+    ssize_t n;
+    while ((n = read(sig_fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < n; i++) events |= signal_event(buf[i]);
+    }
+    return events;
+}
+
+/* Wait up to timeout_ms (-1 for no limit) and return what happened:
+ * EV_INPUT (only if want_input), EV_INTERRUPT, EV_CHILD, EV_RESIZE, or
+ * EV_TIMEOUT when the time ran out first. */
+int event_wait(int timeout_ms, int want_input) {
+    struct pollfd pfd[2];
+    int n = 0;
+    int input = -1;
+
+    if (sig_fd >= 0) {
+        pfd[n].fd = sig_fd;
+        pfd[n].events = POLLIN;
+        pfd[n++].revents = 0;
+    }
+    if (want_input) {
+        input = n;
+        pfd[n].fd = STDIN_FILENO;
+        pfd[n].events = POLLIN;
+        pfd[n++].revents = 0;
+    }
+
+    int r;
+    do {
+        r = poll(pfd, n, timeout_ms);
+    } while (r < 0 && errno == EINTR);
+    if (r == 0) return EV_TIMEOUT;
+    /* Let a read on the terminal report what went wrong. */
+    if (r < 0) return want_input ? EV_INPUT : EV_TIMEOUT;
+
+    int events = 0;
+    if (sig_fd >= 0 && pfd[0].revents) events |= read_signals();
+    if (input >= 0 && pfd[input].revents) events |= EV_INPUT;
+    if (events & EV_CHILD) jobs_reap();
+    return events;
+}
@@ -1,24 +1,302 @@
 #include "quantis.h"
 
-void execute_command(char **argv, int bg) {
+/* Signals the shell handles or ignores that a job should see with their
+ * default action; all are unblocked for it as well. */
+static const int job_signals[] = {
+    SIGINT, SIGCHLD, SIGWINCH, SIGTSTP, SIGTTIN, SIGTTOU
+};
+
+static int make_pipe(int fds[2]) {
+#ifndef __seele__
+    return pipe2(fds, O_CLOEXEC);
+#else
+    if (pipe(fds) < 0) return -1;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+#endif
+}
+
+/* Child side of a fork: join the job's process group and put back
+ * the defaults the shell changed. */
+static void child_setup(pid_t pgid) {
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+    setpgid(0, pgid);
+    for (size_t i = 0; i < sizeof(job_signals) / sizeof(job_signals[0]);
+         i++)
+        signal(job_signals[i], SIG_DFL);
+}
+
+/* Fork and exec path; the child reports a failed execve back over a
+ * close-on-exec pipe so the parent can react to a stale hash entry. */
+static pid_t fork_command(const char *path, char **argv,
+                          const fd_map_t *redirs, int nredirs, pid_t pgid,
+                          int *exec_err) {
+    int err_pipe[2];
+    *exec_err = 0;
+
+    if (make_pipe(err_pipe) < 0) {
+        perror("pipe");
+        return -1;
+    }
+
     pid_t pid = fork();
     if (pid < 0) {
         perror("fork");
-        return;
+        close(err_pipe[0]);
+        close(err_pipe[1]);
+        return -1;
     }
     if (pid == 0) {
-        signal(SIGINT, SIG_DFL);
-        execvp(argv[0], argv);
-        fprintf(stderr, " Quantis: %s: %s\n",
-                argv[0], strerror(errno));
+        close(err_pipe[0]);
+        child_setup(pgid);
+        for (int i = 0; i < nredirs; i++) {
+            if (dup2(redirs[i].src, redirs[i].fd) < 0) {
+                int err = errno;
+                write(err_pipe[1], &err, sizeof(err));
+                _exit(127);
+            }
+        }
+        execve(path, argv, environ);
+        int err = errno;
+        write(err_pipe[1], &err, sizeof(err));
         _exit(127);
     }
-    if (bg) {
-        printf("[%d] %d\n", getpid(), pid);
-    } else {
-        child_pid = pid;
-        waitpid(pid, NULL, 0);
-        child_pid = 0;
+
+    /* Also set from this side, so the group exists before the next
+     * stage is started into it. */
+    setpgid(pid, pgid ? pgid : pid);
+    close(err_pipe[1]);
+    ssize_t n;
+    do {
+        n = read(err_pipe[0], exec_err, sizeof(*exec_err));
+    } while (n < 0 && errno == EINTR);
+    if (n != sizeof(*exec_err)) *exec_err = 0;
+    close(err_pipe[0]);
+
+    if (*exec_err) waitpid(pid, NULL, 0);
+    return pid;
+}
+
+#ifndef __seele__
+/* posix_spawn avoids copying the shell's page tables for a child that
+ * execs right away; the process group and signal defaults are set
+ * through the spawn attributes instead of calls in the child. */
+static pid_t spawn_command(const char *path, char **argv,
+                           const fd_map_t *redirs, int nredirs, pid_t pgid,
+                           int *exec_err) {
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    sigset_t sigdef, sigmask;
+    pid_t pid;
+
+    *exec_err = 0;
+    if (posix_spawnattr_init(&attr) != 0)
+        return fork_command(path, argv, redirs, nredirs, pgid, exec_err);
+    if (posix_spawn_file_actions_init(&actions) != 0) {
+        posix_spawnattr_destroy(&attr);
+        return fork_command(path, argv, redirs, nredirs, pgid, exec_err);
+    }
+    /* Applied in order in the child, so 2>&1 after >file sees the
+     * file. */
+    for (int i = 0; i < nredirs; i++)
+        posix_spawn_file_actions_adddup2(&actions, redirs[i].src,
+                                         redirs[i].fd);
+
+    sigemptyset(&sigdef);
+    for (size_t i = 0; i < sizeof(job_signals) / sizeof(job_signals[0]);
+         i++)
+        sigaddset(&sigdef, job_signals[i]);
+    sigemptyset(&sigmask);
+    posix_spawnattr_setsigdefault(&attr, &sigdef);
+    posix_spawnattr_setsigmask(&attr, &sigmask);
+    posix_spawnattr_setpgroup(&attr, pgid);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF |
+                                        POSIX_SPAWN_SETSIGMASK |
+                                        POSIX_SPAWN_SETPGROUP);
+
+    int err = posix_spawn(&pid, path, &actions, &attr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if (err == ENOSYS)
+        return fork_command(path, argv, redirs, nredirs, pgid, exec_err);
+    if (err) {
+        *exec_err = err;
+        return 0;
+    }
+    return pid;
+}
+#else
+#define spawn_command fork_command
+#endif
+
+/* A builtin inside a pipeline runs in a forked copy of the shell, like
+ * any other stage. */
+static pid_t fork_builtin(char **argv, const fd_map_t *redirs,
+                          int nredirs, int pending_fd, pid_t pgid,
+                          char *rc_file, char *hist_file) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return 0;
+    }
+    if (pid == 0) {
+        child_setup(pgid);
+        for (int i = 0; i < nredirs; i++) {
+            if (dup2(redirs[i].src, redirs[i].fd) < 0) _exit(1);
+        }
+        /* There is no exec to fire O_CLOEXEC: close the descriptors
+         * that were only dup2 sources, and the read end left for the
+         * next stage, or a reader that exits early never makes this
+         * stage see EPIPE and it blocks on a full pipe. */
+        for (int i = 0; i < nredirs; i++) {
+            int src = redirs[i].src;
+            int target = 0;
+            for (int j = 0; j < nredirs; j++)
+                if (redirs[j].fd == src) target = 1;
+            if (src > 2 && !target) close(src);
+        }
+        if (pending_fd >= 0) close(pending_fd);
+        last_status = 0;
+        handle_builtin(argv, rc_file, hist_file);
+        fflush(stdout);
+        _exit(last_status);
     }
+    setpgid(pid, pgid ? pgid : pid);
+    return pid;
 }
 
+/* Start one stage into process group pgid (0 starts a new group).
+ * Returns its pid, or 0 with *status set when nothing was started. */
+static pid_t launch_stage(const stage_t *st, const fd_map_t *redirs,
+                          int nredirs, int pending_fd, pid_t pgid,
+                          char *rc_file, char *hist_file, int *status) {
+    char **argv = st->argv;
+    *status = 0;
+    if (!argv[0]) return 0;
+    if (is_builtin(argv[0]))
+        return fork_builtin(argv, redirs, nredirs, pending_fd, pgid,
+                            rc_file, hist_file);
+
+    int hashed = (strchr(argv[0], '/') == NULL);
+    const char *path = hashed ? cmd_hash_resolve(argv[0]) : argv[0];
+    if (!path) {
+        fprintf(stderr, " Quantis: %s: %s\n",
+                argv[0], strerror(ENOENT));
+        *status = 127;
+        return 0;
+    }
+
+    int exec_err;
+    pid_t pid = spawn_command(path, argv, redirs, nredirs, pgid, &exec_err);
+
+    if (exec_err == ENOENT && hashed) {
+        /* The binary moved or vanished since it was hashed. */
+        cmd_hash_forget(argv[0]);
+        path = cmd_hash_resolve(argv[0]);
+        if (path)
+            pid = spawn_command(path, argv, redirs, nredirs, pgid,
+                                &exec_err);
+    }
+    if (pid < 0) {
+        *status = 1;
+        return 0;
+    }
+    if (exec_err) {
+        fprintf(stderr, " Quantis: %s: %s\n",
+                argv[0], strerror(exec_err));
+        if (exec_err == ENOENT && hashed) cmd_hash_forget(argv[0]);
+        *status = (exec_err == ENOENT) ? 127 : 126;
+        return 0;
+    }
+    return pid;
+}
+
+/* Run the stages connected by pipes as one job in a new process group,
+ * and record the last stage's status in last_status. Each stage's own
+ * redirections are applied after its pipe ends. A foreground job is
+ * given the terminal until it exits or stops. */
+void execute_pipeline(const stage_t *stages, int n, int bg,
+                      const char *source, char *rc_file, char *hist_file) {
+    job_t *job = NULL;
+    pid_t pgid = 0;
+    pid_t last_pid = 0;
+    int launch_status = 0;
+    int in_fd = -1;
+
+    last_status = 0;
+    fflush(stdout);
+    for (int i = 0; i < n; i++) {
+        int out[2] = { -1, -1 };
+        if (i < n - 1 && make_pipe(out) < 0) {
+            perror(" Quantis: pipe");
+            last_status = 1;
+            break;
+        }
+
+        fd_map_t map[stages[i].nredirs + 2];
+        int m = 0;
+        if (in_fd >= 0) {
+            map[m].fd = STDIN_FILENO;
+            map[m++].src = in_fd;
+        }
+        if (out[1] >= 0) {
+            map[m].fd = STDOUT_FILENO;
+            map[m++].src = out[1];
+        }
+        memcpy(map + m, stages[i].redirs,
+               stages[i].nredirs * sizeof(fd_map_t));
+        m += stages[i].nredirs;
+
+        int status;
+        pid_t pid = launch_stage(&stages[i], map, m, out[0], pgid,
+                                 rc_file, hist_file, &status);
+
+        /* The shell keeps no pipe ends beyond the one the next stage
+         * reads from. */
+        if (in_fd >= 0) close(in_fd);
+        if (out[1] >= 0) close(out[1]);
+        in_fd = out[0];
+
+        if (pid > 0) {
+            if (!pgid) {
+                pgid = pid;
+                job = job_start(pgid, source);
+                if (!bg) {
+                    fg_pgid = pgid;
+                    terminal_give(pgid);
+                }
+            }
+            if (job) job_add_proc(job, pid);
+        }
+        if (i == n - 1) {
+            last_pid = pid;
+            launch_status = status;
+        }
+    }
+    if (in_fd >= 0) close(in_fd);
+    if (!pgid) {
+        last_status = launch_status;
+        return;
+    }
+    if (!job) {
+        /* No room to track it: the children are reaped as strays. */
+        fg_pgid = 0;
+        terminal_reclaim();
+        last_status = 1;
+        return;
+    }
+
+    if (bg) {
+        printf("[%d] %d\n", job->id, last_pid ? last_pid : pgid);
+        last_status = 0;
+        return;
+    }
+
+    job_wait(job);
+    if (!last_pid) last_status = launch_status;
+}
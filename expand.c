@@ -0,0 +1,128 @@
+#include "quantis.h"
+
+/* Word expansion, done when the command is about to run so that $?
+ * and variables changed by an earlier command in the list are current.
+ * Quotes and backslashes are removed, $VAR, ${VAR}, $? and $$ are
+ * substituted and a leading ~ becomes the home directory. Results are
+ * not split into fields: a variable always expands to one word. */
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+} word_buf_t;
+
+static void put(word_buf_t *w, const char *s, size_t len) {
+    if (w->len + len + 1 > w->cap) {
+        size_t new_cap = w->cap ? w->cap : 64;
+        while (new_cap < w->len + len + 1) new_cap *= 2;
+        char *grown = realloc(w->buf, new_cap);
+        if (!grown) return;
+        w->buf = grown;
+        w->cap = new_cap;
+    }
+    memcpy(w->buf + w->len, s, len);
+    w->len += len;
+}
+
+static int is_name_char(char c, int first) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' ||
+           (!first && c >= '0' && c <= '9');
+}
+
+/* Expand the variable reference at p (just past the '$'); returns the
+ * first character after it. */
+static const char *put_variable(word_buf_t *w, const char *p) {
+    char num[24];
+
+    if (*p == '?') {
+        snprintf(num, sizeof(num), "%d", last_status);
+        put(w, num, strlen(num));
+        return p + 1;
+    }
+    if (*p == '$') {
+        snprintf(num, sizeof(num), "%d", (int)getpid());
+        put(w, num, strlen(num));
+        return p + 1;
+    }
+
+    const char *name = p;
+    const char *end;
+    const char *next;
+    if (*p == '{') {
+        name = p + 1;
+        end = strchr(name, '}');
+        if (!end) {
+            put(w, "$", 1);
+            return p;
+        }
+        next = end + 1;
+    } else {
+        end = p;
+        while (is_name_char(*end, end == p)) end++;
+        if (end == p) {
+            put(w, "$", 1);
+            return p;
+        }
+        next = end;
+    }
+
+    char var[256];
+    size_t len = (size_t)(end - name);
+    if (len >= sizeof(var)) len = sizeof(var) - 1;
+    memcpy(var, name, len);
+    var[len] = '\0';
+
+    const char *value = getenv(var);
+    if (value) put(w, value, strlen(value));
+    return next;
+}
+
+char *expand_word(arena_t *a, const word_t *word) {
+    if (!(word->flags & WORD_EXPAND)) return word->text;
+
+    word_buf_t w = { NULL, 0, 0 };
+    const char *p = word->text;
+
+    if (*p == '~' && (p[1] == '/' || p[1] == '\0')) {
+        char *home = expand_tilde("~");
+        if (home) {
+            put(&w, home, strlen(home));
+            free(home);
+        }
+        p++;
+    }
+
+    while (*p) {
+        if (*p == '\\') {
+            if (p[1]) p++;
+            put(&w, p++, 1);
+        } else if (*p == '\'') {
+            const char *close = strchr(p + 1, '\'');
+            if (!close) close = p + strlen(p);
+            put(&w, p + 1, (size_t)(close - p - 1));
+            p = *close ? close + 1 : close;
+        } else if (*p == '"') {
+            p++;
+            while (*p && *p != '"') {
+                if (*p == '\\' && p[1] && strchr("$\"\\`", p[1])) {
+                    put(&w, p + 1, 1);
+                    p += 2;
+                } else if (*p == '$') {
+                    p = put_variable(&w, p + 1);
+                } else {
+                    put(&w, p++, 1);
+                }
+            }
+            if (*p) p++;
+        } else if (*p == '$') {
+            p = put_variable(&w, p + 1);
+        } else {
+            put(&w, p++, 1);
+        }
+    }
+
+    char *result = arena_strndup(a, w.buf ? w.buf : "", w.len);
+    free(w.buf);
+    return result;
+}
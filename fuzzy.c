@@ -0,0 +1,168 @@
+#include "quantis.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Subsequence matching for QN_COMPLETION=fuzzy, scored along the lines
+ * of fzf: every matched character earns points, matches at the start
+ * of a word or run of matches earn more, and gaps cost a little. */
+
+#define SCORE_MATCH 16
+#define SCORE_GAP_START -3
+#define SCORE_GAP_EXTENSION -1
+#define BONUS_BOUNDARY 8
+#define BONUS_CAMEL 7
+#define BONUS_CONSECUTIVE 4
+#define BONUS_FIRST_CHAR_MULTIPLIER 2
+
+int fuzzy_enabled(void) {
+    static int enabled = -1;
+    if (enabled < 0) {
+        const char *env = getenv("QN_COMPLETION");
+        enabled = env && strcmp(env, "fuzzy") == 0;
+    }
+    return enabled;
+}
+
+static unsigned char fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+/* First offset at or after from whose byte equals c once both have bit
+ * 0x20 set. That folds ASCII case and lets a few punctuation pairs
+ * collide, which is fine for a filter: it may pass a candidate that
+ * fuzzy_score then rejects, but never drops a real match. */
+static size_t find_folded(const char *s, size_t from, size_t len,
+                          unsigned char c) {
+    c |= 0x20;
+#if defined(__AVX2__)
+    __m256i needle = _mm256_set1_epi8((char)c);
+    __m256i bit = _mm256_set1_epi8(0x20);
+    while (from + 32 <= len) {
+        __m256i block = _mm256_or_si256(
+            _mm256_loadu_si256((const __m256i *)(s + from)), bit);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(block, needle));
+        if (mask) return from + (size_t)__builtin_ctz(mask);
+        from += 32;
+    }
+#elif defined(__SSE2__)
+    __m128i needle = _mm_set1_epi8((char)c);
+    __m128i bit = _mm_set1_epi8(0x20);
+    while (from + 16 <= len) {
+        __m128i block = _mm_or_si128(
+            _mm_loadu_si128((const __m128i *)(s + from)), bit);
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_cmpeq_epi8(block, needle));
+        if (mask) return from + (size_t)__builtin_ctz(mask);
+        from += 16;
+    }
+#endif
+    for (; from < len; from++) {
+        if (((unsigned char)s[from] | 0x20) == c) return from;
+    }
+    return len;
+}
+
+static int mask_bit(unsigned char c) {
+    c |= 0x20;
+    if (c >= 'a' && c <= 'z') return c - 'a';
+    if (c >= '0' && c <= '9') return 26 + (c - '0');
+    return 36 + c % 28;
+}
+
+/* The bytes of text folded as find_folded folds them, squeezed into 64
+ * bits. Listings store one per name when they are built, so a query
+ * rules out most candidates with one AND and never reads their bytes:
+ * if (mask & q) != q for the query's mask q, the name cannot match. */
+char_mask_t fuzzy_mask(const char *text, size_t len) {
+    char_mask_t mask = 0;
+    for (size_t i = 0; i < len; i++)
+        mask |= (char_mask_t)1 << mask_bit((unsigned char)text[i]);
+    return mask;
+}
+
+static int may_match(const char *query, size_t qlen, const char *text,
+                     size_t tlen) {
+    size_t pos = 0;
+    for (size_t j = 0; j < qlen; j++) {
+        pos = find_folded(text, pos, tlen, (unsigned char)query[j]);
+        if (pos == tlen) return 0;
+        pos++;
+    }
+    return 1;
+}
+
+static int is_alnum(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c >= 0x80;
+}
+
+static int bonus_at(const char *text, size_t pos) {
+    unsigned char c = (unsigned char)text[pos];
+    if (pos == 0) return BONUS_BOUNDARY;
+    unsigned char prev = (unsigned char)text[pos - 1];
+    if (!is_alnum(prev) && is_alnum(c)) return BONUS_BOUNDARY;
+    if (prev >= 'a' && prev <= 'z' && c >= 'A' && c <= 'Z')
+        return BONUS_CAMEL;
+    return 0;
+}
+
+/* Score of query as a case-insensitive subsequence of text, or
+ * FUZZY_NO_MATCH when it is not one; a real score goes negative when
+ * the gaps outweigh the matches. The match is the shortest window that
+ * ends where the earliest complete match ends. */
+int fuzzy_score(const char *query, size_t qlen, const char *text,
+                size_t tlen) {
+    if (qlen == 0) return 0;
+    if (!may_match(query, qlen, text, tlen)) return FUZZY_NO_MATCH;
+
+    size_t j = 0, end = 0;
+    for (size_t i = 0; i < tlen; i++) {
+        if (fold((unsigned char)text[i]) == fold((unsigned char)query[j]) &&
+            ++j == qlen) {
+            end = i + 1;
+            break;
+        }
+    }
+    if (j < qlen) return FUZZY_NO_MATCH;
+
+    size_t start = end;
+    j = qlen;
+    while (j > 0) {
+        start--;
+        if (fold((unsigned char)text[start]) ==
+            fold((unsigned char)query[j - 1]))
+            j--;
+    }
+
+    int score = 0;
+    int in_gap = 0;
+    int prev_bonus = 0;
+    int consecutive = 0;
+    j = 0;
+    for (size_t i = start; i < end; i++) {
+        if (j < qlen &&
+            fold((unsigned char)text[i]) == fold((unsigned char)query[j])) {
+            int bonus = bonus_at(text, i);
+            if (consecutive) {
+                if (prev_bonus > bonus) bonus = prev_bonus;
+                if (BONUS_CONSECUTIVE > bonus) bonus = BONUS_CONSECUTIVE;
+            }
+            if (j == 0) bonus *= BONUS_FIRST_CHAR_MULTIPLIER;
+            score += SCORE_MATCH + bonus;
+            prev_bonus = bonus;
+            consecutive = 1;
+            in_gap = 0;
+            j++;
+        } else {
+            score += in_gap ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+            in_gap = 1;
+            consecutive = 0;
+            prev_bonus = 0;
+        }
+    }
+    return score;
+}
@@ -25,7 +25,14 @@ void print_help(void) {
     printf("  clear           Clear the screen\n");
     printf("  help            Show builtin commands\n");
     printf("  alias           Create or list aliases\n");
-    printf("  unalias         Remove an alias\n\n");
+    printf("  unalias         Remove an alias\n");
+    printf("  history         List, clear (-c) or resize (-s) history\n");
+    printf("  rehash          Rebuild the command completion index\n");
+    printf("  hash            List, clear (-r) or seed the command hash\n");
+    printf("  jobs            List background and stopped jobs\n");
+    printf("  fg, bg          Resume a job in the foreground or background\n");
+    printf("  wait            Wait for jobs to finish\n");
+    printf("  kill            Signal a job (%%N) or process\n\n");
 }
 
 void print_unknown_option(const char *opt) {
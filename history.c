@@ -1,61 +1,212 @@
 #include "quantis.h"
 
-void add_to_history(const char *line) {
-    char *temp = strdup(line);
-    char *trimmed = temp;
-    while (*trimmed == ' ' || *trimmed == '\t') trimmed++;
-    if (*trimmed == '\0') {
-        free(temp);
-        return;
+int history_default_capacity(void) {
+    const char *env = getenv("HISTSIZE");
+    int cap = env ? atoi(env) : 0;
+    return cap > 0 ? cap : MAX_HISTORY;
+}
+
+/* Entries loaded from disk point into history.map; only entries that
+ * were typed in this session own their text. */
+static void release_entry(hist_entry_t *e) {
+    if (e->text < history.map || e->text >= history.map + history.map_len)
+        free((char *)e->text);
+    e->text = NULL;
+}
+
+static hist_entry_t *entry_at(int index) {
+    return &history.entries[(history.head + index) % history.cap];
+}
+
+/* Logical index 0 is the oldest entry still kept. Slots left by a
+ * repeated command read as NULL and are skipped by callers. */
+const char *history_get(int index, size_t *len) {
+    if (index < 0 || index >= history.count) return NULL;
+    hist_entry_t *e = entry_at(index);
+    if (len) *len = e->len;
+    return e->text;
+}
+
+unsigned history_seq_at(int index) {
+    if (index < 0 || index >= history.count) return 0;
+    return entry_at(index)->seq;
+}
+
+/* Logical index of the first entry numbered seq or later. */
+int history_seq_index(unsigned seq) {
+    int lo = 0, hi = history.count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (entry_at(mid)->seq < seq) lo = mid + 1;
+        else hi = mid;
     }
+    return lo;
+}
 
-    if (history_count > 0 &&
-        strcmp(history[history_count - 1], line) == 0) {
-        free(temp);
-        return;
+/* Entries are numbered in the order they were added; sequence numbers
+ * stay valid while the ring rotates and entries are moved. */
+const char *history_get_seq(unsigned seq, size_t *len) {
+    if (seq < history.base_seq || seq >= history.next_seq) return NULL;
+    int index = history_seq_index(seq);
+    if (index >= history.count || entry_at(index)->seq != seq) return NULL;
+    return history_get(index, len);
+}
+
+static void update_base(void) {
+    history.base_seq =
+        history.count ? entry_at(0)->seq : history.next_seq;
+}
+
+/* Repeated commands keep a single entry unless QN_HISTDEDUP=0. */
+int history_dedup_enabled(void) {
+    static int enabled = -1;
+    if (enabled < 0) {
+        const char *env = getenv("QN_HISTDEDUP");
+        enabled = !(env && strcmp(env, "0") == 0);
     }
-    free(temp);
+    return enabled;
+}
 
-    if (history_count < MAX_HISTORY) {
-        history[history_count++] = strdup(line);
-    } else {
-        free(history[0]);
-        for (int i = 1; i < MAX_HISTORY; i++) {
-            history[i - 1] = history[i];
-        }
-        history[MAX_HISTORY - 1] = strdup(line);
+/* Take the entry at index out of the ring. Its slot stays behind as a
+ * tombstone (NULL text) instead of the ring shifting down over it, so
+ * repeating a command costs the same however long the history is. */
+static void remove_entry(int index) {
+    hist_entry_t *e = entry_at(index);
+    if (!e->text) return;
+    if (history_dedup_enabled()) history_intern_remove(e->text, e->len);
+    release_entry(e);
+    e->len = 0;
+    history.dead++;
+}
+
+/* Squeeze the tombstones out in one pass. Only done once they fill a
+ * quarter of a full ring, so the cost is spread over the removals. */
+static void compact_entries(void) {
+    int kept = 0;
+    for (int i = 0; i < history.count; i++) {
+        hist_entry_t *e = entry_at(i);
+        if (e->text) *entry_at(kept++) = *e;
     }
-    history_current = history_count;
+    history.count = kept;
+    history.dead = 0;
+    update_base();
 }
 
-void load_history(const char *hist_file) {
-    FILE *f = fopen(hist_file, "r");
-    if (!f) return;
+void history_push_ref(const char *text, size_t len) {
+    if (!history.entries) history_set_capacity(history_default_capacity());
+    if (!history.entries) return;
 
-    char line[MAX_LINE];
-    while (fgets(line, sizeof(line), f)) {
-        line[strcspn(line, "\n")] = 0;
-        if (strlen(line) > 0 && line[0] != '#') {
-            if (history_count < MAX_HISTORY) {
-                history[history_count++] = strdup(line);
-            }
-        }
+    if (history_dedup_enabled()) {
+        unsigned earlier = history_intern_find(text, len);
+        if (earlier) remove_entry(history_seq_index(earlier));
     }
-    fclose(f);
-    history_current = history_count;
+    if (history.count == history.cap && history.dead * 4 >= history.cap)
+        compact_entries();
+    if (history.count == history.cap) {
+        hist_entry_t *e = entry_at(0);
+        if (!e->text)
+            history.dead--;
+        else if (history_dedup_enabled())
+            history_intern_remove(e->text, e->len);
+        release_entry(e);
+        history.head = (history.head + 1) % history.cap;
+        history.count--;
+    }
+
+    hist_entry_t *e = entry_at(history.count);
+    e->text = text;
+    e->len = len;
+    e->seq = history.next_seq++;
+    history.count++;
+    update_base();
+
+    if (history_dedup_enabled()) history_intern_add(e->seq, text, len);
+    history_index_add(e->seq, text, len);
+    history_trie_add(e->seq, text, len);
+}
+
+void history_push(char *line) {
+    if (!line) return;
+    if (!history.entries) history_set_capacity(history_default_capacity());
+    if (!history.entries) {
+        free(line);
+        return;
+    }
+    history_push_ref(line, strlen(line));
 }
 
-void save_history(const char *hist_file) {
-    FILE *f = fopen(hist_file, "w");
-    if (!f) {
-        /* On some targets (like your own OS), the filesystem or
-         * directory used for history may not be writable or may not
-         * exist. In that case we simply skip saving history instead
-         * of treating it as a runtime error. */
+void history_set_capacity(int cap) {
+    if (cap <= 0) return;
+
+    hist_entry_t *entries = malloc(cap * sizeof(hist_entry_t));
+    if (!entries) {
+        perror("malloc for history");
         return;
     }
-    for (int i = 0; i < history_count; i++) {
-        fprintf(f, "%s\n", history[i]);
+
+    int live = history.count - history.dead;
+    int keep = live < cap ? live : cap;
+    int drop = live - keep;
+    int n = 0;
+    for (int i = 0; i < history.count; i++) {
+        hist_entry_t *e = entry_at(i);
+        if (!e->text) continue;
+        if (drop > 0) {
+            release_entry(e);
+            drop--;
+        } else {
+            entries[n++] = *e;
+        }
     }
-    fclose(f);
+
+    free(history.entries);
+    history.entries = entries;
+    history.cap = cap;
+    history.head = 0;
+    history.count = keep;
+    history.dead = 0;
+    update_base();
+    history_current = history.count;
+
+    if (history_dedup_enabled()) {
+        history_intern_reset();
+        for (int i = 0; i < history.count; i++)
+            history_intern_add(entries[i].seq, entries[i].text,
+                               entries[i].len);
+    }
+}
+
+void history_clear(void) {
+    for (int i = 0; i < history.count; i++) release_entry(entry_at(i));
+    history.head = 0;
+    history.count = 0;
+    history.dead = 0;
+    update_base();
+    history_intern_reset();
+    history_index_reset();
+    history_trie_reset();
+    history_current = 0;
+}
+
+void history_free(void) {
+    history_clear();
+    free(history.entries);
+    history.entries = NULL;
+    history.cap = 0;
+    history_unmap();
+}
+
+void add_to_history(const char *line) {
+    const char *trimmed = line;
+    while (*trimmed == ' ' || *trimmed == '\t') trimmed++;
+    if (*trimmed == '\0') return;
+
+    size_t len = strlen(line);
+    size_t last_len;
+    const char *last = history_get(history.count - 1, &last_len);
+    if (last && last_len == len && memcmp(last, line, len) == 0) return;
+
+    /* history_flush puts it in the ring after any lines other shells
+     * wrote meanwhile. */
+    history_queue_write(line);
 }
@@ -0,0 +1,396 @@
+#include "quantis.h"
+#ifndef __seele__
+#include <sys/file.h>
+#endif
+
+#define HISTORY_HEADER "# .qnhistory\n\n"
+
+/* Several shells can share one history file. Each appends under an
+ * exclusive lock and remembers how far into the file it has read, so
+ * lines written by the others are picked up at the next prompt
+ * without reading the file again. */
+
+static char *hist_path = NULL;
+static int hist_fd = -1;
+static dev_t hist_dev = 0;
+static ino_t hist_ino = 0;
+static off_t read_offset = 0;
+static size_t *known = NULL;     /* hashes of the ring's texts */
+static size_t known_count = 0;
+static off_t known_until = 0;    /* lines before this may be known */
+static char *pending = NULL;
+static size_t pending_len = 0;
+static size_t pending_cap = 0;
+static int map_on_heap = 0;
+
+static int fsync_enabled(void) {
+    const char *env = getenv("QN_HISTFSYNC");
+    return env && *env && strcmp(env, "0") != 0;
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static void lock_file(int fd, int exclusive) {
+#ifndef __seele__
+    while (flock(fd, exclusive ? LOCK_EX : LOCK_UN) < 0 && errno == EINTR)
+        ;
+#else
+    (void)fd;
+    (void)exclusive;
+#endif
+}
+
+/* Open the file for appending and reading; closing the old descriptor
+ * also drops any lock held through it. */
+static void open_append(void) {
+    if (hist_fd >= 0) close(hist_fd);
+    hist_fd = open(hist_path, O_RDWR | O_APPEND | O_CREAT, 0644);
+    if (hist_fd < 0) return;
+    fcntl(hist_fd, F_SETFD, FD_CLOEXEC);
+
+    struct stat st;
+    if (fstat(hist_fd, &st) == 0) {
+        hist_dev = st.st_dev;
+        hist_ino = st.st_ino;
+    }
+}
+
+static int compare_hashes(const void *a, const void *b) {
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void forget_known(void) {
+    free(known);
+    known = NULL;
+    known_count = 0;
+    known_until = 0;
+}
+
+/* Note what the ring holds, so a re-read of a replaced file can skip
+ * the lines this shell already has. */
+static void remember_known(off_t until) {
+    forget_known();
+    known = malloc((history.count + 1) * sizeof(size_t));
+    if (!known) return;
+    for (int i = 0; i < history.count; i++) {
+        size_t len;
+        const char *text = history_get(i, &len);
+        if (text) known[known_count++] = hash_bytes(text, len);
+    }
+    qsort(known, known_count, sizeof(size_t), compare_hashes);
+    known_until = until;
+}
+
+static int is_known(const char *text, size_t len) {
+    size_t hash = hash_bytes(text, len);
+    return bsearch(&hash, known, known_count, sizeof(size_t),
+                   compare_hashes) != NULL;
+}
+
+/* Another shell compacts by renaming a new file over the path; follow
+ * it to the new file and read that from the start. It holds what the
+ * other shell kept, which can include lines appended by a third shell
+ * that this one never read, and anything appended after the rename:
+ * those are taken in, while lines already in the ring are skipped. */
+static int reopen_if_replaced(void) {
+    struct stat st;
+    if (stat(hist_path, &st) != 0) return 0;
+    if (st.st_dev == hist_dev && st.st_ino == hist_ino) return 0;
+
+    open_append();
+    read_offset = 0;
+    if (hist_fd >= 0 && fstat(hist_fd, &st) == 0)
+        remember_known(st.st_size);
+    return 1;
+}
+
+/* Push the complete lines in [read_offset, end) into the ring. A line
+ * still being written is left for the next call. */
+static void merge_from(off_t end) {
+    size_t want = (size_t)(end - read_offset);
+    char *buf = malloc(want);
+    if (!buf) return;
+
+    size_t got = 0;
+    while (got < want) {
+        ssize_t n = pread(hist_fd, buf + got, want - got,
+                          read_offset + (off_t)got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+
+    size_t start = 0;
+    for (size_t i = 0; i < got; i++) {
+        if (buf[i] != '\n') continue;
+        size_t len = i - start;
+        int skip = read_offset + (off_t)start < known_until &&
+                   is_known(buf + start, len);
+        if (len > 0 && buf[start] != '#' && !skip) {
+            char *line = malloc(len + 1);
+            if (line) {
+                memcpy(line, buf + start, len);
+                line[len] = '\0';
+                history_push(line);
+            }
+        }
+        start = i + 1;
+    }
+    read_offset += (off_t)start;
+    if (read_offset >= known_until) forget_known();
+    free(buf);
+}
+
+/* Called before each prompt: one stat of the path and one of the open
+ * file, plus a read of whatever other shells appended since. */
+void history_sync(void) {
+    if (!hist_path || hist_fd < 0) return;
+    reopen_if_replaced();
+    if (hist_fd < 0) return;
+
+    struct stat st;
+    if (fstat(hist_fd, &st) != 0) return;
+    if (st.st_size < read_offset) read_offset = st.st_size;
+    if (st.st_size > read_offset) merge_from(st.st_size);
+    history_current = history.count;
+}
+
+/* Rewrite the file with only the entries still kept in memory. The
+ * new contents go to a temp file that is renamed over the old one, so
+ * a crash leaves either the old or the new file, never a torn one. */
+static void compact_history(void) {
+    size_t tmp_len = strlen(hist_path) + 32;
+    char *tmp = malloc(tmp_len);
+    if (!tmp) return;
+    snprintf(tmp, tmp_len, "%s.tmp.%d", hist_path, (int)getpid());
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(tmp);
+        return;
+    }
+
+    int failed = write_all(fd, HISTORY_HEADER, strlen(HISTORY_HEADER));
+    for (int i = 0; i < history.count && !failed; i++) {
+        size_t len;
+        const char *line = history_get(i, &len);
+        if (!line) continue;
+        failed = write_all(fd, line, len) ||
+                 write_all(fd, "\n", 1);
+    }
+    if (!failed && fsync_enabled()) failed = fsync(fd);
+    close(fd);
+
+    if (failed || rename(tmp, hist_path) != 0) unlink(tmp);
+    free(tmp);
+}
+
+void history_queue_write(const char *line) {
+    size_t len = strlen(line);
+    if (pending_len + len + 1 > pending_cap) {
+        size_t new_cap = pending_cap ? pending_cap : 256;
+        while (new_cap < pending_len + len + 1) new_cap *= 2;
+        char *grown = realloc(pending, new_cap);
+        if (!grown) return;
+        pending = grown;
+        pending_cap = new_cap;
+    }
+    memcpy(pending + pending_len, line, len);
+    pending[pending_len + len] = '\n';
+    pending_len += len + 1;
+}
+
+/* Push the queued lines into the ring and append them to the file.
+ * Under the lock, lines other shells appended are taken in first, so
+ * the ring ends in the same order as the file and the line just
+ * entered stays the newest. */
+void history_flush(void) {
+    if (pending_len == 0) return;
+
+    /* Lock, then make sure the file was not replaced while waiting. */
+    while (hist_fd >= 0) {
+        lock_file(hist_fd, 1);
+        if (!reopen_if_replaced()) break;
+    }
+
+    struct stat st;
+    if (hist_fd >= 0 && fstat(hist_fd, &st) == 0 &&
+        st.st_size > read_offset)
+        merge_from(st.st_size);
+
+    for (size_t start = 0, i = 0; i < pending_len; i++) {
+        if (pending[i] != '\n') continue;
+        char *line = malloc(i - start + 1);
+        if (line) {
+            memcpy(line, pending + start, i - start);
+            line[i - start] = '\0';
+            history_push(line);
+        }
+        start = i + 1;
+    }
+    history_current = history.count;
+
+    if (hist_fd >= 0) {
+        if (write_all(hist_fd, pending, pending_len) == 0) {
+            if (fsync_enabled()) fsync(hist_fd);
+            if (fstat(hist_fd, &st) == 0) read_offset = st.st_size;
+        }
+        lock_file(hist_fd, 0);
+    }
+    pending_len = 0;
+}
+
+/* Map the file, or read it into one heap block where mmap is not
+ * available, so loaded entries can point straight into it. */
+static int map_history(int fd, size_t size) {
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+        history.map = map;
+        history.map_len = size;
+        map_on_heap = 0;
+        return 1;
+    }
+
+    char *buf = malloc(size);
+    if (!buf) return 0;
+    size_t got = 0;
+    while (got < size) {
+        ssize_t n = read(fd, buf + got, size - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    history.map = buf;
+    history.map_len = got;
+    map_on_heap = 1;
+    return 1;
+}
+
+void history_unmap(void) {
+    if (!history.map) return;
+    if (map_on_heap)
+        free((char *)history.map);
+    else
+        munmap((void *)history.map, history.map_len);
+    history.map = NULL;
+    history.map_len = 0;
+}
+
+/* With dedup on, the backward scan keeps only the newest copy of each
+ * line: seen[] is a small open-addressing set of indexes into found[]. */
+static int seen_before(int *seen, size_t mask, const hist_entry_t *found,
+                       int nfound) {
+    const hist_entry_t *e = &found[nfound];
+    size_t i = hash_bytes(e->text, e->len) & mask;
+    while (seen[i]) {
+        const hist_entry_t *o = &found[seen[i] - 1];
+        if (o->len == e->len && memcmp(o->text, e->text, e->len) == 0)
+            return 1;
+        i = (i + 1) & mask;
+    }
+    seen[i] = nfound + 1;
+    return 0;
+}
+
+void load_history(const char *hist_file) {
+    free(hist_path);
+    hist_path = strdup(hist_file);
+    if (!hist_path) return;
+
+    int fd = open(hist_file, O_RDONLY);
+    struct stat st;
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0 &&
+        map_history(fd, (size_t)st.st_size)) {
+        if (!history.entries) history_set_capacity(history_default_capacity());
+        hist_entry_t *found = malloc(history.cap * sizeof(hist_entry_t));
+        int nfound = 0;
+        int more = 0;
+
+        size_t seen_cap = 16;
+        while (seen_cap < (size_t)history.cap * 2) seen_cap *= 2;
+        int *seen = history_dedup_enabled() ? calloc(seen_cap, sizeof(int))
+                                            : NULL;
+
+        /* Walk backwards from the end so only the newest entries that
+         * fit in the ring are ever touched. */
+        const char *end = history.map + history.map_len;
+        while (found && end > history.map) {
+            const char *line_end = end;
+            const char *start = line_end;
+            while (start > history.map && start[-1] != '\n') start--;
+            end = (start > history.map) ? start - 1 : history.map;
+
+            size_t len = (size_t)(line_end - start);
+            if (len == 0 || start[0] == '#') continue;
+            if (nfound == history.cap) {
+                more = 1;
+                break;
+            }
+            found[nfound].text = start;
+            found[nfound].len = len;
+            if (seen && seen_before(seen, seen_cap - 1, found, nfound))
+                continue;
+            nfound++;
+        }
+        free(seen);
+
+        for (int i = nfound - 1; i >= 0; i--)
+            history_push_ref(found[i].text, found[i].len);
+        free(found);
+
+        read_offset = st.st_size;
+        open_append();
+
+        /* Compact under the lock, after taking in anything another
+         * shell appended since the file was mapped. */
+        if (more && st.st_size > HISTORY_COMPACT_SIZE && hist_fd >= 0) {
+            lock_file(hist_fd, 1);
+            struct stat now;
+            if (fstat(hist_fd, &now) == 0 && now.st_size > read_offset)
+                merge_from(now.st_size);
+            compact_history();
+            open_append();
+            read_offset = (hist_fd >= 0 && fstat(hist_fd, &now) == 0)
+                              ? now.st_size : 0;
+        }
+    }
+    if (fd >= 0) close(fd);
+    history_current = history.count;
+
+    if (hist_fd < 0) {
+        open_append();
+        struct stat now;
+        read_offset = (hist_fd >= 0 && fstat(hist_fd, &now) == 0)
+                          ? now.st_size : 0;
+    }
+}
+
+void save_history(const char *hist_file) {
+    (void)hist_file;
+    /* Lines are appended as they are entered, so exit only has to
+     * push out whatever is still queued. On some targets the history
+     * file cannot be opened at all; then nothing is written. */
+    history_flush();
+    if (hist_fd >= 0) {
+        close(hist_fd);
+        hist_fd = -1;
+    }
+    free(pending);
+    pending = NULL;
+    pending_len = pending_cap = 0;
+    forget_known();
+    free(hist_path);
+    hist_path = NULL;
+}
@@ -0,0 +1,160 @@
+#include "quantis.h"
+
+/* Trigram index over the history ring. Every three-byte window of an
+ * entry maps to a posting list: the ascending sequence numbers of the
+ * entries that contain it. Entries that leave the ring are trimmed
+ * from a list lazily, the next time that list has to grow. */
+
+typedef struct {
+    unsigned key;   /* trigram + 1, so 0 marks a free slot */
+    unsigned *seqs;
+    size_t n;
+    size_t cap;
+} posting_t;
+
+static posting_t *grams = NULL;
+static size_t gram_cap = 0;
+static size_t gram_used = 0;
+
+static unsigned trigram(const char *p) {
+    return (((unsigned)(unsigned char)p[0] << 16) |
+            ((unsigned)(unsigned char)p[1] << 8) |
+            (unsigned)(unsigned char)p[2]) + 1;
+}
+
+static size_t gram_slot(unsigned key, size_t cap) {
+    return (size_t)(key * 2654435761u) & (cap - 1);
+}
+
+static posting_t *gram_find(unsigned key) {
+    if (!grams) return NULL;
+    size_t mask = gram_cap - 1;
+    for (size_t i = gram_slot(key, gram_cap);; i = (i + 1) & mask) {
+        if (grams[i].key == key) return &grams[i];
+        if (grams[i].key == 0) return NULL;
+    }
+}
+
+static int gram_grow(void) {
+    size_t new_cap = gram_cap ? gram_cap * 2 : 1024;
+    posting_t *table = calloc(new_cap, sizeof(posting_t));
+    if (!table) return 0;
+
+    for (size_t i = 0; i < gram_cap; i++) {
+        if (grams[i].key == 0) continue;
+        size_t j = gram_slot(grams[i].key, new_cap);
+        while (table[j].key) j = (j + 1) & (new_cap - 1);
+        table[j] = grams[i];
+    }
+    free(grams);
+    grams = table;
+    gram_cap = new_cap;
+    return 1;
+}
+
+static posting_t *gram_insert(unsigned key) {
+    posting_t *p = gram_find(key);
+    if (p) return p;
+    if ((gram_used + 1) * 10 > gram_cap * 7 && !gram_grow()) return NULL;
+
+    size_t i = gram_slot(key, gram_cap);
+    while (grams[i].key) i = (i + 1) & (gram_cap - 1);
+    grams[i].key = key;
+    gram_used++;
+    return &grams[i];
+}
+
+/* First position in p->seqs holding a value >= seq. */
+static size_t lower_bound(const posting_t *p, unsigned seq) {
+    size_t lo = 0, hi = p->n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (p->seqs[mid] < seq) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void posting_append(posting_t *p, unsigned seq) {
+    if (p->n && p->seqs[p->n - 1] == seq) return;
+
+    if (p->n == p->cap) {
+        size_t kept = 0;
+        for (size_t i = lower_bound(p, history.base_seq); i < p->n; i++) {
+            if (history_get_seq(p->seqs[i], NULL))
+                p->seqs[kept++] = p->seqs[i];
+        }
+        p->n = kept;
+
+        /* Grow unless trimming freed at least half, so a list that
+         * keeps filling up is not trimmed on every append. */
+        if (p->n * 2 > p->cap || p->cap == 0) {
+            size_t new_cap = p->cap ? p->cap * 2 : 4;
+            unsigned *grown = realloc(p->seqs, new_cap * sizeof(unsigned));
+            if (!grown) return;
+            p->seqs = grown;
+            p->cap = new_cap;
+        }
+    }
+    p->seqs[p->n++] = seq;
+}
+
+void history_index_add(unsigned seq, const char *text, size_t len) {
+    for (size_t i = 0; i + 3 <= len; i++) {
+        posting_t *p = gram_insert(trigram(text + i));
+        if (p) posting_append(p, seq);
+    }
+}
+
+void history_index_reset(void) {
+    for (size_t i = 0; i < gram_cap; i++) free(grams[i].seqs);
+    free(grams);
+    grams = NULL;
+    gram_cap = 0;
+    gram_used = 0;
+}
+
+static int contains(const char *text, size_t len, const char *query,
+                    size_t qlen) {
+    if (!text || qlen > len) return 0;
+    for (size_t i = 0; i + qlen <= len; i++) {
+        if (text[i] == query[0] && memcmp(text + i, query, qlen) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+/* Newest entry older than sequence number `before` that contains the
+ * query, or 0. Candidates come from the query's rarest trigram and are
+ * confirmed against the text; queries under three bytes are scanned. */
+unsigned history_search(const char *query, size_t qlen, unsigned before) {
+    unsigned oldest = history.base_seq;
+    if (qlen == 0 || before <= oldest) return 0;
+
+    size_t len;
+    const char *text;
+
+    if (qlen < 3) {
+        for (int i = history_seq_index(before); i-- > 0;) {
+            text = history_get(i, &len);
+            if (contains(text, len, query, qlen))
+                return history_seq_at(i);
+        }
+        return 0;
+    }
+
+    posting_t *rarest = NULL;
+    for (size_t i = 0; i + 3 <= qlen; i++) {
+        posting_t *p = gram_find(trigram(query + i));
+        if (!p || p->n == 0) return 0;
+        if (!rarest || p->n < rarest->n) rarest = p;
+    }
+
+    for (size_t i = lower_bound(rarest, before); i-- > 0;) {
+        unsigned seq = rarest->seqs[i];
+        if (seq < oldest) break;
+        text = history_get_seq(seq, &len);
+        if (contains(text, len, query, qlen)) return seq;
+    }
+    return 0;
+}
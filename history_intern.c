@@ -0,0 +1,92 @@
+#include "quantis.h"
+
+/* Set of the texts in the history ring, keyed by content and pointing
+ * at the entry's sequence number, so a repeated command finds its
+ * earlier copy without scanning the ring. */
+
+typedef struct {
+    size_t hash;
+    unsigned seq;   /* 0 marks a free slot */
+} intern_slot_t;
+
+static intern_slot_t *slots = NULL;
+static size_t slot_cap = 0;
+static size_t slot_used = 0;
+
+static size_t find_slot(const char *text, size_t len, size_t hash) {
+    size_t mask = slot_cap - 1;
+    size_t i = hash & mask;
+    while (slots[i].seq) {
+        if (slots[i].hash == hash) {
+            size_t elen;
+            const char *e = history_get_seq(slots[i].seq, &elen);
+            if (e && elen == len && memcmp(e, text, len) == 0) return i;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static int grow_slots(void) {
+    size_t new_cap = slot_cap ? slot_cap * 2 : 256;
+    intern_slot_t *table = calloc(new_cap, sizeof(intern_slot_t));
+    if (!table) return 0;
+
+    for (size_t i = 0; i < slot_cap; i++) {
+        if (!slots[i].seq) continue;
+        size_t j = slots[i].hash & (new_cap - 1);
+        while (table[j].seq) j = (j + 1) & (new_cap - 1);
+        table[j] = slots[i];
+    }
+    free(slots);
+    slots = table;
+    slot_cap = new_cap;
+    return 1;
+}
+
+/* Sequence number of the entry holding this text, or 0. */
+unsigned history_intern_find(const char *text, size_t len) {
+    if (!slot_cap) return 0;
+    return slots[find_slot(text, len, hash_bytes(text, len))].seq;
+}
+
+/* Record the newest entry; its text must already be in the ring. */
+void history_intern_add(unsigned seq, const char *text, size_t len) {
+    if ((slot_used + 1) * 4 > slot_cap * 3 && !grow_slots()) return;
+
+    size_t hash = hash_bytes(text, len);
+    size_t i = find_slot(text, len, hash);
+    if (!slots[i].seq) slot_used++;
+    slots[i].hash = hash;
+    slots[i].seq = seq;
+}
+
+/* Forget an entry; call while its text is still in the ring. */
+void history_intern_remove(const char *text, size_t len) {
+    if (!slot_cap || !text) return;
+
+    size_t mask = slot_cap - 1;
+    size_t i = find_slot(text, len, hash_bytes(text, len));
+    if (!slots[i].seq) return;
+    slots[i].seq = 0;
+    slot_used--;
+
+    size_t j = i;
+    while (1) {
+        j = (j + 1) & mask;
+        if (!slots[j].seq) break;
+        size_t home = slots[j].hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            slots[i] = slots[j];
+            slots[j].seq = 0;
+            i = j;
+        }
+    }
+}
+
+void history_intern_reset(void) {
+    free(slots);
+    slots = NULL;
+    slot_cap = 0;
+    slot_used = 0;
+}
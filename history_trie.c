@@ -0,0 +1,146 @@
+#include "quantis.h"
+
+/* Radix trie over the history ring for inline suggestions. Each node
+ * records the newest sequence number anywhere beneath it, so the
+ * suggestion for a prefix is read off the node the prefix ends in,
+ * whatever the size of the history. A subtree whose newest entry has
+ * rotated out of the ring is dead as a whole and is pruned when an
+ * insert passes by it. */
+
+/* Labels are not stored: a node's label is the slice of its newest
+ * entry's text starting at the node's depth, since every entry beneath
+ * the node shares those bytes. The history ring holds each distinct
+ * text once, so the trie adds only its nodes on top of it. */
+typedef struct trie_node {
+    size_t depth;
+    size_t label_len;
+    unsigned best;
+    struct trie_node *child;
+    struct trie_node *next;
+} trie_node_t;
+
+static trie_node_t *root = NULL;
+
+static void free_node(trie_node_t *node) {
+    while (node) {
+        trie_node_t *next = node->next;
+        free_node(node->child);
+        free(node);
+        node = next;
+    }
+}
+
+static trie_node_t *new_node(size_t depth, size_t len, unsigned best) {
+    trie_node_t *node = calloc(1, sizeof(trie_node_t));
+    if (!node) return NULL;
+    node->depth = depth;
+    node->label_len = len;
+    node->best = best;
+    return node;
+}
+
+static const char *label_of(const trie_node_t *node) {
+    size_t len;
+    const char *text = history_get_seq(node->best, &len);
+    return text ? text + node->depth : NULL;
+}
+
+/* Child of node whose label starts with key[0], and that label. While
+ * adding, dead siblings are unlinked on the way; a live child whose
+ * entry has just been dropped as a duplicate of the text being added
+ * has the same bytes as key, so key stands in for its label. */
+static trie_node_t *child_for(trie_node_t *node, const char *key,
+                              const char **label, int adding) {
+    trie_node_t **link = &node->child;
+    while (*link) {
+        trie_node_t *child = *link;
+        if (child->best < history.base_seq) {
+            if (adding) {
+                *link = child->next;
+                child->next = NULL;
+                free_node(child);
+            } else {
+                link = &child->next;
+            }
+            continue;
+        }
+        *label = label_of(child);
+        if (!*label && adding) *label = key;
+        if (*label && (*label)[0] == key[0]) return child;
+        link = &child->next;
+    }
+    return NULL;
+}
+
+/* Cut node's label after k bytes; the rest moves to a new child. */
+static int split(trie_node_t *node, size_t k) {
+    trie_node_t *tail = new_node(node->depth + k, node->label_len - k,
+                                 node->best);
+    if (!tail) return 0;
+    tail->child = node->child;
+    node->child = tail;
+    node->label_len = k;
+    return 1;
+}
+
+/* Add the entry numbered seq; its text must already be in the ring. */
+void history_trie_add(unsigned seq, const char *text, size_t len) {
+    if (!root) root = new_node(0, 0, seq);
+    if (!root) return;
+    root->best = seq;
+
+    trie_node_t *node = root;
+    size_t pos = 0;
+    while (pos < len) {
+        const char *label;
+        trie_node_t *child = child_for(node, text + pos, &label, 1);
+        if (!child) {
+            child = new_node(pos, len - pos, seq);
+            if (!child) return;
+            child->next = node->child;
+            node->child = child;
+            return;
+        }
+
+        size_t k = 1;
+        while (k < child->label_len && pos + k < len &&
+               label[k] == text[pos + k])
+            k++;
+        if (k < child->label_len && !split(child, k)) return;
+
+        child->best = seq;
+        node = child;
+        pos += k;
+    }
+}
+
+void history_trie_reset(void) {
+    free_node(root);
+    root = NULL;
+}
+
+/* Rest of the newest entry that starts with prefix, or NULL when no
+ * entry extends it. */
+const char *history_suggest(const char *prefix, size_t plen,
+                            size_t *rest_len) {
+    trie_node_t *node = root;
+    size_t pos = 0;
+    while (node && pos < plen) {
+        const char *label;
+        node = child_for(node, prefix + pos, &label, 0);
+        if (!node) return NULL;
+        size_t k = 0;
+        while (k < node->label_len && pos < plen) {
+            if (label[k] != prefix[pos]) return NULL;
+            k++;
+            pos++;
+        }
+    }
+    if (!node || node->best < history.base_seq) return NULL;
+
+    size_t len;
+    const char *text = history_get_seq(node->best, &len);
+    if (!text || len <= plen) return NULL;
+    *rest_len = len - plen;
+    return text + plen;
+}
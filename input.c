@@ -1,96 +1,284 @@
 #include "quantis.h"
 
-char *read_command_line(int prompt_len) {
-    (void)prompt_len;
-    char *line_buffer = calloc(MAX_LINE, 1);
-    if (!line_buffer) {
-        perror("calloc");
-        return NULL;
+static char *kill_buf = NULL;
+static size_t kill_len = 0;
+
+/* Byte offset of the character before / after pos, skipping UTF-8
+ * continuation bytes so the cursor never lands inside a character. */
+static size_t prev_char(const linebuf_t *lb, size_t pos) {
+    if (pos == 0) return 0;
+    pos--;
+    while (pos > 0 && ((unsigned char)lb_char_at(lb, pos) & 0xc0) == 0x80)
+        pos--;
+    return pos;
+}
+
+static size_t next_char(const linebuf_t *lb, size_t pos) {
+    size_t len = lb_len(lb);
+    if (pos >= len) return len;
+    pos++;
+    while (pos < len && ((unsigned char)lb_char_at(lb, pos) & 0xc0) == 0x80)
+        pos++;
+    return pos;
+}
+
+static int is_word_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_' || (unsigned char)c >= 0x80;
+}
+
+static size_t word_left(const linebuf_t *lb, size_t pos) {
+    while (pos > 0 && !is_word_char(lb_char_at(lb, pos - 1))) pos--;
+    while (pos > 0 && is_word_char(lb_char_at(lb, pos - 1))) pos--;
+    return pos;
+}
+
+static size_t word_right(const linebuf_t *lb, size_t pos) {
+    size_t len = lb_len(lb);
+    while (pos < len && !is_word_char(lb_char_at(lb, pos))) pos++;
+    while (pos < len && is_word_char(lb_char_at(lb, pos))) pos++;
+    return pos;
+}
+
+/* Ctrl-W erases back to the previous whitespace, like a Unix tty. */
+static size_t space_word_left(const linebuf_t *lb, size_t pos) {
+    while (pos > 0 && lb_char_at(lb, pos - 1) == ' ') pos--;
+    while (pos > 0 && lb_char_at(lb, pos - 1) != ' ') pos--;
+    return pos;
+}
+
+/* Cut [from, to) into the kill buffer and leave the cursor at from. */
+static void kill_range(linebuf_t *lb, size_t from, size_t to) {
+    if (from >= to) return;
+
+    char *grown = realloc(kill_buf, to - from);
+    if (grown) {
+        kill_buf = grown;
+        kill_len = to - from;
+        lb_copy(lb, from, to, kill_buf);
     }
-    int len = 0;
-    history_current = history_count;
+
+    lb_move_to(lb, to);
+    lb_delete_back(lb, to - from);
+}
+
+/* The rest of the newest history entry that extends the line, offered
+ * only while the cursor sits at the end. */
+static const char *suggestion(const linebuf_t *lb, size_t *len) {
+    if (lb->gap_start == 0 || lb->gap_end != lb->size) return NULL;
+    return history_suggest(lb->buf, lb->gap_start, len);
+}
+
+/* Right, End, Ctrl-E and Ctrl-F at the end of the line take the
+ * suggestion instead of doing nothing. */
+static int accept_suggestion(linebuf_t *lb) {
+    size_t len = 0;
+    const char *rest = suggestion(lb, &len);
+    if (!rest) return 0;
+    lb_insert(lb, rest, len);
+    return 1;
+}
+
+static void draw(linebuf_t *lb) {
+    size_t hint_len = 0;
+    const char *hint = suggestion(lb, &hint_len);
+    render_hint(hint, hint_len);
+    render_text(lb->buf, lb->gap_start, lb->buf + lb->gap_end,
+                lb->size - lb->gap_end, lb->gap_start, lb->dirty_from);
+    lb->dirty_from = (size_t)-1;
+}
+
+char *read_command_line(const char *prompt) {
+    linebuf_t lb;
+    lb_init(&lb);
+    history_current = history.count;
+    path_index_mark_stale();
+    render_begin(prompt);
+    int dirty = 1;
+    int idle_pending = 0;
+    key_event_t replay_key;
+    int replay = 0;
 
     while (1) {
-        char c;
-        if (read(STDIN_FILENO, &c, 1) <= 0) {
-            free(line_buffer);
+        /* Keys that arrived together are applied first and drawn as
+         * one frame. */
+        if (dirty && !replay && !key_pending()) {
+            draw(&lb);
+            dirty = 0;
+        }
+
+        /* A pause after an edit is when Tab is likely: get the
+         * candidates for the word under the cursor going. */
+        if (idle_pending && !replay && !key_wait(PRECOMPUTE_IDLE_MS)) {
+            precompute_start(&lb);
+            idle_pending = 0;
+        }
+
+        /* The key that ended a search is applied to the line it left. */
+        key_event_t key;
+        if (replay) {
+            key = replay_key;
+            replay = 0;
+        } else if (!read_key(&key)) {
+            precompute_stop();
+            lb_free(&lb);
             return NULL;
         }
+        if (key.type == KEY_RESIZE) {
+            render_resize();
+            dirty = 1;
+            continue;
+        }
+        if (key.type == KEY_INTERRUPT) {
+            /* ^C abandons the line for a fresh prompt. */
+            precompute_stop();
+            lb_move_to(&lb, lb_len(&lb));
+            draw(&lb);
+            render_end();
+            lb_free(&lb);
+            return strdup("");
+        }
+        dirty = 1;
+        idle_pending = 1;
+        /* Tab wants what the worker is scanning; anything else makes
+         * it stale and stops it. */
+        if (key.type != KEY_CHAR || key.ch != '\t') precompute_cancel();
 
-        if (c == '\t') {
-            int result = handle_tab_completion(line_buffer, &len);
-            if (result == 2) {
-                char *prompt = build_prompt();
-                printf("%s%s", prompt, line_buffer);
-                fflush(stdout);
-                free(prompt);
+        size_t cursor = lb.gap_start;
+
+        switch (key.type) {
+        case KEY_TEXT:
+        case KEY_PASTE:
+            /* A typed run or a bracketed paste lands as one block with
+             * one write, however many bytes it holds. */
+            lb_insert(&lb, key.text, key.len);
+            continue;
+
+        case KEY_UP:
+        case KEY_DOWN: {
+            /* Step over the slots left by repeated commands. */
+            int i = history_current;
+            do {
+                i += (key.type == KEY_UP) ? -1 : 1;
+            } while (i >= 0 && i < history.count && !history_get(i, NULL));
+
+            if (i >= 0 && i <= history.count) {
+                history_current = i;
+
+                size_t history_len = 0;
+                const char *history_line =
+                    history_get(history_current, &history_len);
+                lb_set(&lb, history_line ? history_line : "", history_len);
             }
             continue;
         }
 
-        if (c == '\r' || c == '\n') {
-            line_buffer[len] = '\0';
-            write(STDOUT_FILENO, "\n", 1);
+        case KEY_LEFT:
+            lb_move_to(&lb, prev_char(&lb, cursor));
+            continue;
+        case KEY_RIGHT:
+            if (accept_suggestion(&lb)) continue;
+            lb_move_to(&lb, next_char(&lb, cursor));
+            continue;
+        case KEY_WORD_LEFT:
+            lb_move_to(&lb, word_left(&lb, cursor));
+            continue;
+        case KEY_WORD_RIGHT:
+            lb_move_to(&lb, word_right(&lb, cursor));
+            continue;
+        case KEY_HOME:
+            lb_move_to(&lb, 0);
+            continue;
+        case KEY_END:
+            if (accept_suggestion(&lb)) continue;
+            lb_move_to(&lb, lb_len(&lb));
+            continue;
+        case KEY_DELETE:
+            lb_delete_forward(&lb, next_char(&lb, cursor) - cursor);
+            continue;
+
+        case KEY_ALT:
+            if (key.ch == 'b')
+                lb_move_to(&lb, word_left(&lb, cursor));
+            else if (key.ch == 'f')
+                lb_move_to(&lb, word_right(&lb, cursor));
+            else if (key.ch == 'd')
+                kill_range(&lb, cursor, word_right(&lb, cursor));
+            else if (key.ch == 127 || key.ch == '\b')
+                kill_range(&lb, word_left(&lb, cursor), cursor);
+            continue;
+
+        case KEY_CHAR:
             break;
+
+        default:
+            continue;
         }
 
-        if (c == 127 || c == '\b') {
-            if (len > 0) {
-                len--;
-                line_buffer[len] = '\0';
-                write(STDOUT_FILENO, "\b \b", 3);
-            }
+        char c = key.ch;
+
+        if (c == '\t') {
+            draw(&lb);
+            dirty = handle_tab_completion(&lb);
             continue;
         }
 
-        if (c == 27) {
-            char seq[3];
-            if (read(STDIN_FILENO, &seq[0], 1) != 1) continue;
-            if (read(STDIN_FILENO, &seq[1], 1) != 1) continue;
-
-            if (seq[0] == '[' &&
-                (seq[1] == 'A' || seq[1] == 'B')) {
-                int new_history_index = history_current;
-
-                if (seq[1] == 'A') {
-                    if (new_history_index > 0) new_history_index--;
-                } else if (seq[1] == 'B') {
-                    if (new_history_index < history_count)
-                        new_history_index++;
-                }
-
-                if (new_history_index != history_current) {
-                    history_current = new_history_index;
-                    printf("\r\033[K");
-                    fflush(stdout);
-
-                    char *history_line = NULL;
-                    if (history_current < history_count) {
-                        history_line = history[history_current];
-                    }
-
-                    if (history_line) {
-                        len = snprintf(line_buffer, MAX_LINE,
-                                       "%s", history_line);
-                    } else {
-                        len = 0;
-                        line_buffer[0] = '\0';
-                    }
-
-                    printf("  %s", line_buffer);
-                    fflush(stdout);
-                }
+        if (c == 18) {  /* Ctrl-R */
+            int found = reverse_search(&lb, &replay_key);
+            if (found < 0) {
+                precompute_stop();
+                lb_free(&lb);
+                return NULL;
             }
-            continue;
+            replay = (found == 2);
+            if (found != 1) continue;
+            c = '\r';
         }
 
-        if (len < MAX_LINE - 1) {
-            line_buffer[len++] = c;
-            line_buffer[len] = '\0';
-            write(STDOUT_FILENO, &c, 1);
+        if (c == '\r' || c == '\n') {
+            precompute_stop();
+            lb_move_to(&lb, lb_len(&lb));
+            draw(&lb);
+            render_end();
+            break;
+        }
+
+        switch (c) {
+        case 127:
+        case '\b':
+            lb_delete_back(&lb, cursor - prev_char(&lb, cursor));
+            break;
+        case 1:  /* Ctrl-A */
+            lb_move_to(&lb, 0);
+            break;
+        case 5:  /* Ctrl-E */
+            if (accept_suggestion(&lb)) break;
+            lb_move_to(&lb, lb_len(&lb));
+            break;
+        case 2:  /* Ctrl-B */
+            lb_move_to(&lb, prev_char(&lb, cursor));
+            break;
+        case 6:  /* Ctrl-F */
+            if (accept_suggestion(&lb)) break;
+            lb_move_to(&lb, next_char(&lb, cursor));
+            break;
+        case 4:  /* Ctrl-D */
+            lb_delete_forward(&lb, next_char(&lb, cursor) - cursor);
+            break;
+        case 11: /* Ctrl-K */
+            kill_range(&lb, cursor, lb_len(&lb));
+            break;
+        case 21: /* Ctrl-U */
+            kill_range(&lb, 0, cursor);
+            break;
+        case 23: /* Ctrl-W */
+            kill_range(&lb, space_word_left(&lb, cursor), cursor);
+            break;
+        case 25: /* Ctrl-Y */
+            if (kill_len) lb_insert(&lb, kill_buf, kill_len);
+            break;
         }
     }
 
-    return line_buffer;
+    return lb_take(&lb);
 }
-
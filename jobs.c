@@ -0,0 +1,425 @@
+#include "quantis.h"
+
+/* The job table. Every pipeline the shell starts is a job, foreground
+ * or not, so that one place reaps children: the event loop calls
+ * jobs_reap on SIGCHLD, which collects whatever has changed with
+ * waitpid(WNOHANG). Background jobs that finish or stop are reported
+ * before the next prompt. */
+
+static job_t *jobs = NULL;
+static unsigned job_clock = 0;
+
+static const struct {
+    const char *name;
+    int sig;
+} signal_names[] = {
+    { "HUP", SIGHUP },   { "INT", SIGINT },   { "QUIT", SIGQUIT },
+    { "ABRT", SIGABRT }, { "KILL", SIGKILL }, { "SEGV", SIGSEGV },
+    { "PIPE", SIGPIPE }, { "ALRM", SIGALRM }, { "TERM", SIGTERM },
+    { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 }, { "CHLD", SIGCHLD },
+    { "CONT", SIGCONT }, { "STOP", SIGSTOP }, { "TSTP", SIGTSTP },
+    { "TTIN", SIGTTIN }, { "TTOU", SIGTTOU }, { "WINCH", SIGWINCH },
+};
+
+#define NSIGNAL_NAMES (sizeof(signal_names) / sizeof(signal_names[0]))
+
+job_t *job_start(pid_t pgid, const char *command) {
+    job_t *j = calloc(1, sizeof(job_t));
+    if (!j) return NULL;
+    /* Without its text the job could not be listed; leave it
+     * untracked, as when the job itself cannot be allocated. */
+    j->command = strdup(command ? command : "");
+    if (!j->command) {
+        free(j);
+        return NULL;
+    }
+    j->pgid = pgid;
+    j->order = ++job_clock;
+
+    /* Numbered after the highest job still in the table, appended so
+     * the list stays in id order. */
+    job_t **tail = &jobs;
+    j->id = 1;
+    while (*tail) {
+        if ((*tail)->id >= j->id) j->id = (*tail)->id + 1;
+        tail = &(*tail)->next;
+    }
+    *tail = j;
+    return j;
+}
+
+void job_add_proc(job_t *j, pid_t pid) {
+    if (j->nprocs == j->cap) {
+        int new_cap = j->cap ? j->cap * 2 : 4;
+        job_proc_t *grown =
+            realloc(j->procs, new_cap * sizeof(job_proc_t));
+        if (!grown) return;
+        j->procs = grown;
+        j->cap = new_cap;
+    }
+    j->procs[j->nprocs].pid = pid;
+    j->procs[j->nprocs].state = PROC_RUNNING;
+    j->procs[j->nprocs].status = 0;
+    j->nprocs++;
+}
+
+static void job_remove(job_t *j) {
+    for (job_t **p = &jobs; *p; p = &(*p)->next) {
+        if (*p == j) {
+            *p = j->next;
+            break;
+        }
+    }
+    free(j->procs);
+    free(j->command);
+    free(j);
+}
+
+/* PROC_RUNNING while any process runs, else PROC_STOPPED while any is
+ * stopped, else PROC_DONE. */
+static int job_state(const job_t *j) {
+    int state = PROC_DONE;
+    for (int i = 0; i < j->nprocs; i++) {
+        if (j->procs[i].state == PROC_RUNNING) return PROC_RUNNING;
+        if (j->procs[i].state == PROC_STOPPED) state = PROC_STOPPED;
+    }
+    return state;
+}
+
+/* The job's status is that of its last process, the way $? sees it. */
+static int job_status(const job_t *j) {
+    if (!j->nprocs) return 0;
+    int status = j->procs[j->nprocs - 1].status;
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    if (WIFSTOPPED(status)) return 128 + WSTOPSIG(status);
+    return 1;
+}
+
+static void record_status(pid_t pid, int status) {
+    for (job_t *j = jobs; j; j = j->next) {
+        for (int i = 0; i < j->nprocs; i++) {
+            job_proc_t *p = &j->procs[i];
+            if (p->pid != pid) continue;
+
+            /* A stage that touched the terminal before it was handed
+             * over was stopped for it; the group owns it now, so let it
+             * retry. */
+            if (j->pgid == fg_pgid && WIFSTOPPED(status) &&
+                (WSTOPSIG(status) == SIGTTIN ||
+                 WSTOPSIG(status) == SIGTTOU)) {
+                kill(pid, SIGCONT);
+                return;
+            }
+
+            int before = job_state(j);
+            if (WIFSTOPPED(status)) {
+                p->state = PROC_STOPPED;
+                p->status = status;
+            } else if (WIFCONTINUED(status)) {
+                p->state = PROC_RUNNING;
+            } else {
+                p->state = PROC_DONE;
+                p->status = status;
+            }
+            int after = job_state(j);
+            if (after != before) {
+                if (after == PROC_STOPPED) j->order = ++job_clock;
+                if (after != PROC_RUNNING && j->pgid != fg_pgid)
+                    j->notify = 1;
+            }
+            return;
+        }
+    }
+}
+
+void jobs_reap(void) {
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status,
+                          WNOHANG | WUNTRACED | WCONTINUED)) > 0)
+        record_status(pid, status);
+}
+
+static const char *signal_name(int sig) {
+    for (size_t i = 0; i < NSIGNAL_NAMES; i++) {
+        if (signal_names[i].sig == sig) return signal_names[i].name;
+    }
+    return NULL;
+}
+
+static int signal_number(const char *s) {
+    if (*s >= '0' && *s <= '9') return atoi(s);
+    if (!strncmp(s, "SIG", 3)) s += 3;
+    for (size_t i = 0; i < NSIGNAL_NAMES; i++) {
+        if (!strcmp(signal_names[i].name, s)) return signal_names[i].sig;
+    }
+    return -1;
+}
+
+/* The current job (%+) is the one started or stopped most recently,
+ * the previous one (%-) the one before it. */
+static void current_jobs(job_t **current, job_t **previous) {
+    *current = *previous = NULL;
+    for (job_t *j = jobs; j; j = j->next) {
+        if (!*current || j->order > (*current)->order) {
+            *previous = *current;
+            *current = j;
+        } else if (!*previous || j->order > (*previous)->order) {
+            *previous = j;
+        }
+    }
+}
+
+static void print_job(const job_t *j) {
+    job_t *current, *previous;
+    current_jobs(&current, &previous);
+    char mark = (j == current) ? '+' : (j == previous) ? '-' : ' ';
+
+    char state[32];
+    int st = job_state(j);
+    if (st == PROC_RUNNING) {
+        snprintf(state, sizeof(state), "Running");
+    } else if (st == PROC_STOPPED) {
+        snprintf(state, sizeof(state), "Stopped");
+    } else {
+        int status = j->nprocs ? j->procs[j->nprocs - 1].status : 0;
+        const char *name = WIFSIGNALED(status)
+                               ? signal_name(WTERMSIG(status)) : NULL;
+        if (WIFSIGNALED(status) && name)
+            snprintf(state, sizeof(state), "Killed (SIG%s)", name);
+        else if (WIFSIGNALED(status))
+            snprintf(state, sizeof(state), "Killed (%d)", WTERMSIG(status));
+        else if (WEXITSTATUS(status))
+            snprintf(state, sizeof(state), "Exit %d", WEXITSTATUS(status));
+        else
+            snprintf(state, sizeof(state), "Done");
+    }
+    printf("[%d]%c  %-22s%s\n", j->id, mark, state, j->command);
+}
+
+/* Report background jobs that stopped or finished since the last
+ * prompt, and forget the finished ones. */
+void jobs_notify(void) {
+    jobs_reap();
+    job_t *j = jobs;
+    while (j) {
+        job_t *next = j->next;
+        if (j->notify) {
+            print_job(j);
+            j->notify = 0;
+            if (job_state(j) == PROC_DONE) job_remove(j);
+        }
+        j = next;
+    }
+    fflush(stdout);
+}
+
+void jobs_list(void) {
+    jobs_reap();
+    job_t *j = jobs;
+    while (j) {
+        job_t *next = j->next;
+        print_job(j);
+        j->notify = 0;
+        if (job_state(j) == PROC_DONE) job_remove(j);
+        j = next;
+    }
+}
+
+/* Wait for a job that owns the terminal until it exits or stops. A
+ * stopped job stays in the table for fg and bg. An interrupt only
+ * reaches the shell when the terminal could not be handed over, and
+ * is passed on to the job. */
+void job_wait(job_t *j) {
+    fg_pgid = j->pgid;
+    jobs_reap();
+    while (job_state(j) == PROC_RUNNING) {
+        if (event_wait(-1, 0) & EV_INTERRUPT) kill(-j->pgid, SIGINT);
+    }
+    fg_pgid = 0;
+    terminal_reclaim();
+
+    last_status = job_status(j);
+    if (job_state(j) == PROC_STOPPED) {
+        printf("\n");
+        print_job(j);
+    } else {
+        job_remove(j);
+    }
+}
+
+/* %N, %% and %+ (the current job), %- (the previous one); fg and bg
+ * also take a bare number. */
+static job_t *find_job(const char *spec, int bare_number) {
+    job_t *current, *previous;
+    current_jobs(&current, &previous);
+
+    if (!spec || !strcmp(spec, "%%") || !strcmp(spec, "%+") ||
+        !strcmp(spec, "%"))
+        return current;
+    if (!strcmp(spec, "%-")) return previous;
+    if (*spec == '%') spec++;
+    else if (!bare_number) return NULL;
+
+    int id = atoi(spec);
+    for (job_t *j = jobs; j; j = j->next) {
+        if (j->id == id) return j;
+    }
+    return NULL;
+}
+
+static job_t *job_arg(const char *builtin, const char *spec) {
+    jobs_reap();
+    job_t *j = find_job(spec, 1);
+    if (!j) {
+        fprintf(stderr, " Quantis: %s: %s: no such job\n", builtin,
+                spec ? spec : "current");
+        last_status = 1;
+    }
+    return j;
+}
+
+static void job_continue(job_t *j) {
+    for (int i = 0; i < j->nprocs; i++) {
+        if (j->procs[i].state == PROC_STOPPED)
+            j->procs[i].state = PROC_RUNNING;
+    }
+    j->order = ++job_clock;
+    kill(-j->pgid, SIGCONT);
+}
+
+void job_foreground(const char *spec) {
+    job_t *j = job_arg("fg", spec);
+    if (!j) return;
+    if (job_state(j) == PROC_DONE) {
+        last_status = job_status(j);
+        job_remove(j);
+        return;
+    }
+    printf("%s\n", j->command);
+    fflush(stdout);
+    terminal_give(j->pgid);
+    job_continue(j);
+    job_wait(j);
+}
+
+void job_background(const char *spec) {
+    job_t *j = job_arg("bg", spec);
+    if (!j) return;
+    if (job_state(j) == PROC_STOPPED) job_continue(j);
+    printf("[%d]  %s &\n", j->id, j->command);
+}
+
+/* wait [%N | pid ...]: with no operands, wait for every job. Ctrl-C
+ * gives up waiting, not the jobs. */
+void jobs_wait(char **argv) {
+    job_t *targets[MAX_ARGS];
+    int ntargets = 0;
+
+    jobs_reap();
+    for (int i = 1; argv[i] && ntargets < MAX_ARGS; i++) {
+        job_t *j = NULL;
+        if (argv[i][0] == '%') {
+            j = find_job(argv[i], 0);
+        } else {
+            pid_t pid = (pid_t)atoi(argv[i]);
+            for (job_t *k = jobs; k && !j; k = k->next)
+                for (int p = 0; p < k->nprocs; p++)
+                    if (k->procs[p].pid == pid) j = k;
+        }
+        if (!j) {
+            fprintf(stderr, " Quantis: wait: %s: no such job\n",
+                    argv[i]);
+            last_status = 127;
+            return;
+        }
+        targets[ntargets++] = j;
+    }
+
+    while (1) {
+        int pending = 0;
+        if (ntargets) {
+            for (int i = 0; i < ntargets; i++)
+                if (job_state(targets[i]) == PROC_RUNNING) pending = 1;
+        } else {
+            for (job_t *j = jobs; j; j = j->next)
+                if (job_state(j) == PROC_RUNNING) pending = 1;
+        }
+        if (!pending) break;
+
+        if (event_wait(-1, 0) & EV_INTERRUPT) {
+            last_status = 130;
+            return;
+        }
+    }
+
+    last_status = ntargets ? job_status(targets[ntargets - 1]) : 0;
+
+    /* Jobs waited for are not reported again at the prompt. */
+    if (!ntargets) {
+        for (job_t *j = jobs; j; j = j->next) targets[ntargets++] = j;
+    }
+    for (int i = 0; i < ntargets; i++) {
+        job_t *j = targets[i];
+        if (!j || job_state(j) != PROC_DONE) continue;
+        for (int k = i + 1; k < ntargets; k++)
+            if (targets[k] == j) targets[k] = NULL;
+        job_remove(j);
+    }
+}
+
+/* kill [-s SIG | -SIG] (%N | pid)...  and kill -l. */
+void jobs_kill(char **argv) {
+    int sig = SIGTERM;
+    int i = 1;
+
+    if (argv[i] && !strcmp(argv[i], "-l")) {
+        for (size_t k = 0; k < NSIGNAL_NAMES; k++)
+            printf("%2d) SIG%s\n", signal_names[k].sig,
+                   signal_names[k].name);
+        return;
+    }
+    if (argv[i] && !strcmp(argv[i], "-s") && argv[i + 1]) {
+        sig = signal_number(argv[i + 1]);
+        i += 2;
+    } else if (argv[i] && argv[i][0] == '-' && argv[i][1]) {
+        sig = signal_number(argv[i] + 1);
+        i++;
+    }
+    if (sig < 0 || !argv[i]) {
+        fprintf(stderr, " Quantis: kill: Usage: kill [-s sig | -sig] "
+                        "%%job | pid ...\n");
+        last_status = 2;
+        return;
+    }
+
+    jobs_reap();
+    for (; argv[i]; i++) {
+        pid_t target;
+        job_t *j = NULL;
+        if (argv[i][0] == '%') {
+            j = find_job(argv[i], 0);
+            if (!j) {
+                fprintf(stderr, " Quantis: kill: %s: no such job\n",
+                        argv[i]);
+                last_status = 1;
+                continue;
+            }
+            target = -j->pgid;
+        } else {
+            target = (pid_t)atoi(argv[i]);
+        }
+
+        if (kill(target, sig) < 0) {
+            fprintf(stderr, " Quantis: kill: %s: %s\n", argv[i],
+                    strerror(errno));
+            last_status = 1;
+            continue;
+        }
+        /* A stopped job only acts on the signal once it runs again. */
+        if (j && job_state(j) == PROC_STOPPED && sig != SIGSTOP &&
+            sig != SIGTSTP && sig != SIGCONT)
+            kill(target, SIGCONT);
+    }
+}
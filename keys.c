@@ -0,0 +1,261 @@
+#include "quantis.h"
+
+#define KEY_BUF 4096
+#define ESC_TIMEOUT_MS 50
+
+enum { DEC_GROUND, DEC_ESC, DEC_CSI, DEC_SS3, DEC_PASTE };
+
+static unsigned char in_buf[KEY_BUF];
+static size_t in_pos = 0;
+static size_t in_len = 0;
+
+static int dec_state = DEC_GROUND;
+static char csi_params[16];
+static size_t csi_len = 0;
+
+/* Interrupts and resizes seen while waiting, not yet returned as keys. */
+static int signal_events = 0;
+
+static char *paste_buf = NULL;
+static size_t paste_len = 0;
+static size_t paste_cap = 0;
+
+/* Wait in the event loop until input or an event to report as a key
+ * comes in; 0 if the timeout ran out first. */
+static int wait_input(int timeout_ms) {
+    while (!signal_events) {
+        int events = event_wait(timeout_ms, 1);
+        signal_events |= events & (EV_INTERRUPT | EV_RESIZE);
+        if (events & EV_INPUT) return 1;
+        if (events & EV_TIMEOUT) return 0;
+    }
+    return 1;
+}
+
+/* Pull whatever the terminal has ready with a single read(); with a
+ * timeout, give up if nothing arrives in time. Returns 2 when an event
+ * came in instead. */
+static int fill_input(int timeout_ms) {
+    if (in_pos == in_len) in_pos = in_len = 0;
+    if (in_len == KEY_BUF) {
+        memmove(in_buf, in_buf + in_pos, in_len - in_pos);
+        in_len -= in_pos;
+        in_pos = 0;
+    }
+
+    if (!wait_input(timeout_ms)) return 0;
+    if (signal_events) return 2;
+
+    ssize_t n;
+    do {
+        n = read(STDIN_FILENO, in_buf + in_len, KEY_BUF - in_len);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) return -1;
+    in_len += (size_t)n;
+    return 1;
+}
+
+static void paste_put(const char *s, size_t len) {
+    if (paste_len + len > paste_cap) {
+        size_t new_cap = paste_cap ? paste_cap : 256;
+        while (new_cap < paste_len + len) new_cap *= 2;
+        char *grown = realloc(paste_buf, new_cap);
+        if (!grown) return;
+        paste_buf = grown;
+        paste_cap = new_cap;
+    }
+    memcpy(paste_buf + paste_len, s, len);
+    paste_len += len;
+}
+
+static int csi_key(char final, key_event_t *ev) {
+    int param = atoi(csi_params);
+    const char *semi = strchr(csi_params, ';');
+    int mod = semi ? atoi(semi + 1) : 0;
+    int ctrl = (mod == 5 || mod == 3);
+
+    switch (final) {
+    case 'A': ev->type = KEY_UP; return 1;
+    case 'B': ev->type = KEY_DOWN; return 1;
+    case 'C': ev->type = ctrl ? KEY_WORD_RIGHT : KEY_RIGHT; return 1;
+    case 'D': ev->type = ctrl ? KEY_WORD_LEFT : KEY_LEFT; return 1;
+    case 'H': ev->type = KEY_HOME; return 1;
+    case 'F': ev->type = KEY_END; return 1;
+    case '~':
+        switch (param) {
+        case 1: case 7: ev->type = KEY_HOME; return 1;
+        case 4: case 8: ev->type = KEY_END; return 1;
+        case 3: ev->type = KEY_DELETE; return 1;
+        case 200:
+            dec_state = DEC_PASTE;
+            paste_len = 0;
+            return 0;
+        }
+        return 0;
+    }
+    return 0;
+}
+
+/* Feed buffered bytes through the decoder until one key is complete.
+ * Returns 0 when the buffer ran dry mid-sequence. */
+static int decode(key_event_t *ev) {
+    static const char paste_end[] = "\033[201~";
+
+    while (in_pos < in_len) {
+        unsigned char c = in_buf[in_pos];
+
+        switch (dec_state) {
+        case DEC_GROUND:
+            if (c == 27) {
+                dec_state = DEC_ESC;
+                in_pos++;
+                break;
+            }
+            if (c >= 0x20 && c != 0x7f) {
+                size_t start = in_pos;
+                while (in_pos < in_len && in_buf[in_pos] >= 0x20 &&
+                       in_buf[in_pos] != 0x7f)
+                    in_pos++;
+                ev->type = KEY_TEXT;
+                ev->text = (const char *)in_buf + start;
+                ev->len = in_pos - start;
+                return 1;
+            }
+            in_pos++;
+            ev->type = KEY_CHAR;
+            ev->ch = (char)c;
+            return 1;
+
+        case DEC_ESC:
+            in_pos++;
+            if (c == '[') {
+                dec_state = DEC_CSI;
+                csi_len = 0;
+                csi_params[0] = '\0';
+            } else if (c == 'O') {
+                dec_state = DEC_SS3;
+            } else {
+                dec_state = DEC_GROUND;
+                ev->type = KEY_ALT;
+                ev->ch = (char)c;
+                return 1;
+            }
+            break;
+
+        case DEC_CSI:
+            in_pos++;
+            if (c >= 0x30 && c <= 0x3f) {
+                if (csi_len < sizeof(csi_params) - 1) {
+                    csi_params[csi_len++] = (char)c;
+                    csi_params[csi_len] = '\0';
+                }
+            } else if (c >= 0x40 && c <= 0x7e) {
+                dec_state = DEC_GROUND;
+                if (csi_key((char)c, ev)) return 1;
+            }
+            break;
+
+        case DEC_SS3:
+            in_pos++;
+            dec_state = DEC_GROUND;
+            csi_params[0] = '\0';
+            if (csi_key((char)c, ev)) return 1;
+            break;
+
+        case DEC_PASTE: {
+            /* Copy everything up to the end marker in one go; the
+             * marker itself may be split across reads. */
+            size_t start = in_pos;
+            size_t matched = 0;
+            while (in_pos < in_len && matched < sizeof(paste_end) - 1) {
+                if (in_buf[in_pos] == (unsigned char)paste_end[matched]) {
+                    matched++;
+                } else if (matched) {
+                    matched = 0;
+                    continue;
+                }
+                in_pos++;
+            }
+            if (matched == sizeof(paste_end) - 1) {
+                paste_put((const char *)in_buf + start,
+                          in_pos - start - matched);
+                dec_state = DEC_GROUND;
+                for (size_t i = 0; i < paste_len; i++) {
+                    if (paste_buf[i] == '\r' || paste_buf[i] == '\n' ||
+                        paste_buf[i] == '\t')
+                        paste_buf[i] = ' ';
+                }
+                ev->type = KEY_PASTE;
+                ev->text = paste_buf;
+                ev->len = paste_len;
+                return 1;
+            }
+            paste_put((const char *)in_buf + start,
+                      in_pos - start - matched);
+            in_pos -= matched;
+            return 0;
+        }
+        }
+    }
+    return 0;
+}
+
+/* True when another complete key may already be buffered. */
+int key_pending(void) {
+    return dec_state == DEC_GROUND && in_pos < in_len;
+}
+
+/* Wait up to timeout_ms for input; true if a key is on its way. */
+int key_wait(int timeout_ms) {
+    if (in_pos < in_len || dec_state != DEC_GROUND) return 1;
+    return wait_input(timeout_ms);
+}
+
+/* ^C drops whatever was typed ahead along with the line. */
+static int signal_key(key_event_t *ev) {
+    if (signal_events & EV_INTERRUPT) {
+        signal_events = 0;
+        in_pos = in_len = 0;
+        dec_state = DEC_GROUND;
+        ev->type = KEY_INTERRUPT;
+        return 1;
+    }
+    if (signal_events & EV_RESIZE) {
+        signal_events &= ~EV_RESIZE;
+        ev->type = KEY_RESIZE;
+        return 1;
+    }
+    return 0;
+}
+
+/* Return the next key, blocking until one is complete. A bare ESC is
+ * told apart from the start of a sequence by a short timeout. */
+int read_key(key_event_t *ev) {
+    ev->text = NULL;
+    ev->len = 0;
+    ev->ch = 0;
+
+    while (1) {
+        if (signal_events & EV_INTERRUPT) return signal_key(ev);
+        if (decode(ev)) return 1;
+        if (signal_key(ev)) return 1;
+
+        int timeout = -1;
+        if (dec_state == DEC_ESC || dec_state == DEC_CSI ||
+            dec_state == DEC_SS3)
+            timeout = ESC_TIMEOUT_MS;
+
+        int r = fill_input(timeout);
+        if (r < 0) {
+            ev->type = KEY_EOF;
+            return 0;
+        }
+        if (r == 2) continue;
+        if (r == 0 && dec_state == DEC_ESC) {
+            dec_state = DEC_GROUND;
+            ev->type = KEY_ESC;
+            return 1;
+        }
+        if (r == 0) dec_state = DEC_GROUND;
+    }
+}
@@ -0,0 +1,133 @@
+#include "quantis.h"
+
+/* Split a command line into words and operators. Words are left in
+ * place in the line; quotes and escapes are only located here, so that
+ * operators inside them are not split on, and are removed when the
+ * word is expanded just before its command runs. */
+
+static int is_blank(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static int is_operator(char c) {
+    return c == '|' || c == '&' || c == ';' || c == '<' || c == '>';
+}
+
+static token_t *push_token(arena_t *a, token_t **tokens, int *count,
+                           int *cap) {
+    if (*count == *cap) {
+        int new_cap = *cap ? *cap * 2 : 32;
+        token_t *grown = arena_alloc(a, new_cap * sizeof(token_t));
+        if (!grown) return NULL;
+        if (*count) memcpy(grown, *tokens, *count * sizeof(token_t));
+        *tokens = grown;
+        *cap = new_cap;
+    }
+    token_t *t = &(*tokens)[(*count)++];
+    memset(t, 0, sizeof(*t));
+    return t;
+}
+
+/* End of the word starting at p, or NULL when a quote is left open. */
+static char *scan_word(char *p, int *flags) {
+    *flags = (*p == '~') ? WORD_EXPAND : 0;
+    while (*p && !is_blank(*p) && !is_operator(*p)) {
+        if (*p == '\\') {
+            *flags |= WORD_EXPAND;
+            if (p[1]) p++;
+        } else if (*p == '\'') {
+            *flags |= WORD_EXPAND;
+            p = strchr(p + 1, '\'');
+            if (!p) return NULL;
+        } else if (*p == '"') {
+            *flags |= WORD_EXPAND;
+            p++;
+            while (*p && *p != '"') {
+                if (*p == '\\' && p[1]) p++;
+                p++;
+            }
+            if (!*p) return NULL;
+        } else if (*p == '$') {
+            *flags |= WORD_EXPAND;
+        }
+        p++;
+    }
+    return p;
+}
+
+/* Tokenize line, ending with TOK_END. Returns 0 and prints why on a
+ * syntax error. */
+int lex_line(arena_t *a, char *line, token_t **tokens, int *ntokens) {
+    int count = 0, cap = 0;
+    *tokens = NULL;
+    char *p = line;
+
+    while (1) {
+        while (is_blank(*p)) p++;
+        if (*p == '#') p += strlen(p);
+
+        token_t *t = push_token(a, tokens, &count, &cap);
+        if (!t) return 0;
+        t->text = p;
+
+        if (!*p) {
+            t->type = TOK_END;
+            break;
+        }
+
+        /* A redirection may name its descriptor: 2>file, 2>&1. */
+        char *q = p;
+        int fd = -1;
+        if (*q >= '0' && *q <= '9') {
+            fd = 0;
+            while (*q >= '0' && *q <= '9') fd = fd * 10 + (*q++ - '0');
+            if (*q != '<' && *q != '>') {
+                fd = -1;
+                q = p;
+            }
+        }
+
+        if (*q == '<') {
+            t->type = TOK_REDIR;
+            t->redir = REDIR_IN;
+            t->fd = fd >= 0 ? fd : 0;
+            q++;
+        } else if (*q == '>') {
+            t->type = TOK_REDIR;
+            t->fd = fd >= 0 ? fd : 1;
+            q++;
+            if (*q == '>') {
+                t->redir = REDIR_APPEND;
+                q++;
+            } else if (*q == '&') {
+                t->redir = REDIR_DUP;
+                q++;
+            } else {
+                t->redir = REDIR_OUT;
+            }
+        } else if (*q == '|') {
+            t->type = (q[1] == '|') ? TOK_OR : TOK_PIPE;
+            q += (q[1] == '|') ? 2 : 1;
+        } else if (*q == '&') {
+            t->type = (q[1] == '&') ? TOK_AND : TOK_AMP;
+            q += (q[1] == '&') ? 2 : 1;
+        } else if (*q == ';') {
+            t->type = TOK_SEMI;
+            q++;
+        } else {
+            t->type = TOK_WORD;
+            q = scan_word(p, &t->flags);
+            if (!q) {
+                fprintf(stderr, " Quantis: syntax error: unterminated "
+                                "quote\n");
+                return 0;
+            }
+        }
+
+        t->len = (size_t)(q - p);
+        p = q;
+    }
+
+    *ntokens = count;
+    return 1;
+}
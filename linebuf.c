@@ -0,0 +1,118 @@
+#include "quantis.h"
+
+/* Gap buffer: text before the cursor sits at buf[0, gap_start), text
+ * after it at buf[gap_end, size). Inserting or deleting at the cursor
+ * only moves the gap edges; the gap is moved when the cursor moves. */
+
+#define LB_MIN_GAP 64
+
+void lb_init(linebuf_t *lb) {
+    lb->buf = NULL;
+    lb->size = 0;
+    lb->gap_start = 0;
+    lb->gap_end = 0;
+    lb->dirty_from = 0;
+}
+
+void lb_free(linebuf_t *lb) {
+    free(lb->buf);
+    lb_init(lb);
+}
+
+size_t lb_len(const linebuf_t *lb) {
+    return lb->size - (lb->gap_end - lb->gap_start);
+}
+
+char lb_char_at(const linebuf_t *lb, size_t pos) {
+    return pos < lb->gap_start ? lb->buf[pos]
+                               : lb->buf[pos + (lb->gap_end - lb->gap_start)];
+}
+
+static void mark_dirty(linebuf_t *lb, size_t pos) {
+    if (pos < lb->dirty_from) lb->dirty_from = pos;
+}
+
+static int reserve(linebuf_t *lb, size_t need) {
+    size_t gap = lb->gap_end - lb->gap_start;
+    if (gap >= need) return 1;
+
+    size_t tail = lb->size - lb->gap_end;
+    size_t new_size = lb->size ? lb->size * 2 : 256;
+    while (new_size - (lb->size - gap) < need + LB_MIN_GAP) new_size *= 2;
+
+    char *grown = realloc(lb->buf, new_size);
+    if (!grown) return 0;
+    memmove(grown + new_size - tail, grown + lb->gap_end, tail);
+    lb->buf = grown;
+    lb->gap_end = new_size - tail;
+    lb->size = new_size;
+    return 1;
+}
+
+void lb_move_to(linebuf_t *lb, size_t pos) {
+    size_t len = lb_len(lb);
+    if (pos > len) pos = len;
+
+    if (pos < lb->gap_start) {
+        size_t n = lb->gap_start - pos;
+        memmove(lb->buf + lb->gap_end - n, lb->buf + pos, n);
+        lb->gap_start -= n;
+        lb->gap_end -= n;
+    } else if (pos > lb->gap_start) {
+        size_t n = pos - lb->gap_start;
+        memmove(lb->buf + lb->gap_start, lb->buf + lb->gap_end, n);
+        lb->gap_start += n;
+        lb->gap_end += n;
+    }
+}
+
+int lb_insert(linebuf_t *lb, const char *text, size_t n) {
+    if (!reserve(lb, n)) return 0;
+    mark_dirty(lb, lb->gap_start);
+    memcpy(lb->buf + lb->gap_start, text, n);
+    lb->gap_start += n;
+    return 1;
+}
+
+void lb_delete_back(linebuf_t *lb, size_t n) {
+    if (n > lb->gap_start) n = lb->gap_start;
+    lb->gap_start -= n;
+    mark_dirty(lb, lb->gap_start);
+}
+
+void lb_delete_forward(linebuf_t *lb, size_t n) {
+    size_t tail = lb->size - lb->gap_end;
+    if (n > tail) n = tail;
+    lb->gap_end += n;
+    mark_dirty(lb, lb->gap_start);
+}
+
+/* Copy [from, to) into dst, which must hold to - from bytes. */
+void lb_copy(const linebuf_t *lb, size_t from, size_t to, char *dst) {
+    for (size_t i = from; i < to; i++) *dst++ = lb_char_at(lb, i);
+}
+
+void lb_set(linebuf_t *lb, const char *text, size_t n) {
+    mark_dirty(lb, 0);
+    lb->gap_start = 0;
+    lb->gap_end = lb->size;
+    lb_insert(lb, text, n);
+}
+
+/* NUL-terminated view of the text before the cursor, which already
+ * sits contiguously in front of the gap. Valid until the next edit. */
+const char *lb_before_cursor(linebuf_t *lb) {
+    if (!reserve(lb, 1)) return NULL;
+    lb->buf[lb->gap_start] = '\0';
+    return lb->buf;
+}
+
+/* Hand the line over to the caller as a malloc'd string. */
+char *lb_take(linebuf_t *lb) {
+    lb_move_to(lb, lb_len(lb));
+    if (!reserve(lb, 1)) return NULL;
+    lb->buf[lb->gap_start] = '\0';
+    char *text = lb->buf;
+    lb_init(lb);
+    return text;
+}
@@ -1,7 +1,12 @@
 #include "quantis.h"
 
 int quantis_main(int argc, char *argv[]) {
-    signal(SIGINT, sigint_handler);
+    events_init();
+    /* Job control belongs to the jobs: the shell is never stopped by
+     * ^Z, and takes the terminal back from the background. */
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
 
     if (argc > 1) {
         if (strcmp(argv[1], "--version") == 0 ||
@@ -22,7 +27,14 @@ int quantis_main(int argc, char *argv[]) {
             printf("  clear           Clear the screen\n");
             printf("  help            Show builtin commands\n");
             printf("  alias           Create or list aliases\n");
-            printf("  unalias         Remove an alias\n\n");
+            printf("  unalias         Remove an alias\n");
+            printf("  history         List, clear (-c) or resize (-s) history\n");
+            printf("  rehash          Rebuild the command completion index\n");
+            printf("  hash            List, clear (-r) or seed the command hash\n");
+            printf("  jobs            List background and stopped jobs\n");
+            printf("  fg, bg          Resume a job in the foreground or background\n");
+            printf("  wait            Wait for jobs to finish\n");
+            printf("  kill            Signal a job (%%N) or process\n\n");
             return 0;
         } else {
             print_unknown_option(argv[1]);
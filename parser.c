@@ -0,0 +1,188 @@
+#include "quantis.h"
+
+/* Recursive descent over the token array:
+ *
+ *     list     := pipeline ((';' | '&' | '&&' | '||') pipeline)* [';' | '&']
+ *     pipeline := command ('|' command)*
+ *     command  := (word | redirection word)+
+ *
+ * Everything is allocated from the line's arena. */
+
+typedef struct {
+    arena_t *arena;
+    token_t *tokens;
+    int pos;
+    int failed;
+} parser_t;
+
+static const char *token_name(const token_t *t) {
+    switch (t->type) {
+    case TOK_PIPE: return "|";
+    case TOK_AND: return "&&";
+    case TOK_OR: return "||";
+    case TOK_SEMI: return ";";
+    case TOK_AMP: return "&";
+    case TOK_REDIR: return "redirection";
+    case TOK_END: return "newline";
+    }
+    return "word";
+}
+
+static void syntax_error(parser_t *ps) {
+    if (!ps->failed)
+        fprintf(stderr, " Quantis: syntax error near `%s'\n",
+                token_name(&ps->tokens[ps->pos]));
+    ps->failed = 1;
+}
+
+static token_t *peek(parser_t *ps) {
+    return &ps->tokens[ps->pos];
+}
+
+static command_t *parse_command(parser_t *ps) {
+    int start = ps->pos;
+    int nwords = 0;
+    while (peek(ps)->type == TOK_WORD || peek(ps)->type == TOK_REDIR) {
+        if (peek(ps)->type == TOK_REDIR) {
+            ps->pos++;
+            if (peek(ps)->type != TOK_WORD) {
+                syntax_error(ps);
+                return NULL;
+            }
+        } else {
+            nwords++;
+        }
+        ps->pos++;
+    }
+    if (ps->pos == start) {
+        syntax_error(ps);
+        return NULL;
+    }
+
+    command_t *cmd = arena_alloc(ps->arena, sizeof(command_t));
+    word_t *words = arena_alloc(ps->arena, (nwords + 1) * sizeof(word_t));
+    if (!cmd || !words) {
+        ps->failed = 1;
+        return NULL;
+    }
+    cmd->words = words;
+    cmd->nwords = 0;
+    cmd->redirs = NULL;
+    cmd->next = NULL;
+
+    redir_t **tail = &cmd->redirs;
+    for (int i = start; i < ps->pos; i++) {
+        token_t *t = &ps->tokens[i];
+        if (t->type == TOK_WORD) {
+            words[cmd->nwords].text = t->text;
+            words[cmd->nwords].flags = t->flags;
+            cmd->nwords++;
+            continue;
+        }
+
+        redir_t *r = arena_alloc(ps->arena, sizeof(redir_t));
+        if (!r) {
+            ps->failed = 1;
+            return NULL;
+        }
+        r->fd = t->fd;
+        r->kind = t->redir;
+        r->target.text = ps->tokens[i + 1].text;
+        r->target.flags = ps->tokens[i + 1].flags;
+        r->next = NULL;
+        *tail = r;
+        tail = &r->next;
+        i++;
+    }
+    return cmd;
+}
+
+static pipeline_t *parse_pipeline(parser_t *ps) {
+    token_t *first_token = peek(ps);
+
+    pipeline_t *pl = arena_alloc(ps->arena, sizeof(pipeline_t));
+    if (!pl) {
+        ps->failed = 1;
+        return NULL;
+    }
+    pl->first = NULL;
+    pl->stages = 0;
+    pl->bg = 0;
+    pl->op = LIST_SEQ;
+    pl->next = NULL;
+
+    command_t **tail = &pl->first;
+    while (1) {
+        command_t *cmd = parse_command(ps);
+        if (!cmd) return NULL;
+        *tail = cmd;
+        tail = &cmd->next;
+        pl->stages++;
+        if (peek(ps)->type != TOK_PIPE) break;
+        ps->pos++;
+    }
+
+    /* The text is copied out before words are cut apart in place. */
+    token_t *last = &ps->tokens[ps->pos - 1];
+    pl->source = arena_strndup(ps->arena, first_token->text,
+                               (size_t)(last->text + last->len -
+                                        first_token->text));
+    return pl;
+}
+
+pipeline_t *parse_tokens(arena_t *a, token_t *tokens, int ntokens) {
+    (void)ntokens;
+    parser_t ps = { a, tokens, 0, 0 };
+    pipeline_t *head = NULL;
+    pipeline_t **tail = &head;
+
+    while (peek(&ps)->type != TOK_END) {
+        pipeline_t *pl = parse_pipeline(&ps);
+        if (!pl) return NULL;
+        *tail = pl;
+        tail = &pl->next;
+
+        int type = peek(&ps)->type;
+        if (type == TOK_END) break;
+        ps.pos++;
+        if (type == TOK_AMP) {
+            pl->bg = 1;
+        } else if (type == TOK_AND || type == TOK_OR) {
+            pl->op = (type == TOK_AND) ? LIST_AND : LIST_OR;
+            if (peek(&ps)->type == TOK_END) {
+                syntax_error(&ps);
+                return NULL;
+            }
+        } else if (type != TOK_SEMI) {
+            ps.pos--;
+            syntax_error(&ps);
+            return NULL;
+        }
+    }
+    return head;
+}
+
+/* Lex and parse one line. Words are NUL-terminated in place once the
+ * whole line has been tokenized, so the AST points into the line. An
+ * empty line gives NULL with *error clear. */
+pipeline_t *parse_command_line(arena_t *a, char *line, int *error) {
+    token_t *tokens;
+    int ntokens;
+    *error = 0;
+
+    if (!lex_line(a, line, &tokens, &ntokens)) {
+        *error = 1;
+        return NULL;
+    }
+    pipeline_t *list = parse_tokens(a, tokens, ntokens);
+    if (!list) {
+        *error = (tokens[0].type != TOK_END);
+        return NULL;
+    }
+
+    for (int i = 0; i < ntokens; i++) {
+        if (tokens[i].type == TOK_WORD)
+            tokens[i].text[tokens[i].len] = '\0';
+    }
+    return list;
+}
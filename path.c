@@ -27,6 +27,20 @@ char *expand_tilde(const char *path) {
     return expanded;
 }
 
+/* Copy the PATH entry that starts at path into dir and return where
+ * the next one starts, or NULL after the last. As execvp does, an empty
+ * entry (a leading, trailing or doubled ':') means the current
+ * directory. */
+const char *path_next(const char *path, char *dir, size_t size) {
+    const char *end = strchr(path, ':');
+    size_t len = end ? (size_t)(end - path) : strlen(path);
+    if (len == 0)
+        snprintf(dir, size, ".");
+    else
+        snprintf(dir, size, "%.*s", (int)len, path);
+    return end ? end + 1 : NULL;
+}
+
 char *get_program_directory(void) {
     char path[PATH_BUF];
     ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
@@ -0,0 +1,318 @@
+#include "quantis.h"
+#ifndef __seele__
+#include <pthread.h>
+#endif
+
+typedef struct {
+    char *path;
+    time_t mtime;
+    char **names;
+    int count;
+} path_dir_t;
+
+static char *index_path = NULL;
+static path_dir_t *index_dirs = NULL;
+static int index_dir_count = 0;
+static char **index_names = NULL;
+static char_mask_t *index_masks = NULL;   /* fuzzy_mask of each name */
+static int index_name_count = 0;
+/* Set by the input thread at each prompt without taking the completion
+ * lock, so it never waits on a scan; accessed atomically. */
+static int index_stale = 1;
+
+/* Set while the precompute worker refreshes the index: scans check it
+ * between entries and give up once it says the work is not wanted. */
+static int (*scan_stop)(void) = NULL;
+
+static int scan_stopped(void) {
+    return scan_stop && scan_stop();
+}
+
+static void free_dir_names(path_dir_t *d) {
+    for (int i = 0; i < d->count; i++) free(d->names[i]);
+    free(d->names);
+    d->names = NULL;
+    d->count = 0;
+}
+
+static void free_dirs(void) {
+    for (int i = 0; i < index_dir_count; i++) {
+        free_dir_names(&index_dirs[i]);
+        free(index_dirs[i].path);
+    }
+    free(index_dirs);
+    index_dirs = NULL;
+    index_dir_count = 0;
+}
+
+/* Stat entries relative to the open directory rather than through a
+ * rebuilt full path. */
+static int entry_executable(DIR *dir, const char *dir_path,
+                            const char *name) {
+#ifndef __seele__
+    (void)dir_path;
+    struct stat st;
+    if (fstatat(dirfd(dir), name, &st, 0) != 0) return 0;
+    return S_ISREG(st.st_mode) && (st.st_mode & S_IXUSR);
+#else
+    (void)dir;
+    char full_path[PATH_BUF];
+    snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, name);
+    return is_executable(full_path);
+#endif
+}
+
+/* The listing is built aside and only replaces the old one once it is
+ * complete; a stopped scan leaves the directory as it was, still
+ * stale. */
+static void scan_dir(path_dir_t *d) {
+    struct stat st;
+    if (stat(d->path, &st) != 0) {
+        free_dir_names(d);
+        d->mtime = 0;
+        return;
+    }
+    /* A listing taken in the same second as the last change could
+     * miss a later change with an identical mtime; keep such a dir
+     * stale so the next check scans it again. */
+    time_t mtime = (st.st_mtime >= time(NULL)) ? (time_t)-1 : st.st_mtime;
+    /* A relative entry names a different directory after every cd. */
+    if (d->path[0] != '/') mtime = (time_t)-1;
+
+    path_dir_t scan = { d->path, mtime, NULL, 0 };
+    DIR *dir = opendir(d->path);
+    if (dir) {
+        int cap = 0;
+        struct dirent *entry;
+        while ((entry = readdir(dir))) {
+            if (scan_stopped()) {
+                closedir(dir);
+                free_dir_names(&scan);
+                return;
+            }
+            if (entry->d_name[0] == '.' &&
+                (entry->d_name[1] == '\0' ||
+                 (entry->d_name[1] == '.' && entry->d_name[2] == '\0')))
+                continue;
+
+            if (!entry_executable(dir, d->path, entry->d_name)) continue;
+
+            if (scan.count == cap) {
+                int new_cap = cap ? cap * 2 : 64;
+                char **grown =
+                    realloc(scan.names, new_cap * sizeof(char *));
+                if (!grown) break;
+                scan.names = grown;
+                cap = new_cap;
+            }
+            scan.names[scan.count++] = strdup(entry->d_name);
+        }
+        closedir(dir);
+    }
+
+    free_dir_names(d);
+    d->names = scan.names;
+    d->count = scan.count;
+    d->mtime = mtime;
+}
+
+static void load_dirs(const char *path_env) {
+    free_dirs();
+    free(index_path);
+    index_path = strdup(path_env);
+
+    int cap = 0;
+    for (const char *p = *path_env ? path_env : NULL; p;) {
+        char dir[PATH_BUF];
+        p = path_next(p, dir, sizeof(dir));
+        if (index_dir_count == cap) {
+            int new_cap = cap ? cap * 2 : 16;
+            path_dir_t *grown =
+                realloc(index_dirs, new_cap * sizeof(path_dir_t));
+            if (!grown) break;
+            index_dirs = grown;
+            cap = new_cap;
+        }
+        path_dir_t *d = &index_dirs[index_dir_count++];
+        d->path = strdup(dir);
+        d->mtime = (time_t)-1;
+        d->names = NULL;
+        d->count = 0;
+    }
+}
+
+static void merge_names(void) {
+    free(index_names);
+    free(index_masks);
+    index_names = NULL;
+    index_masks = NULL;
+    index_name_count = 0;
+
+    int total = 0;
+    for (int i = 0; i < index_dir_count; i++)
+        total += index_dirs[i].count;
+    if (total == 0) return;
+
+    index_names = malloc(total * sizeof(char *));
+    if (!index_names) return;
+
+    for (int i = 0; i < index_dir_count; i++) {
+        memcpy(index_names + index_name_count, index_dirs[i].names,
+               index_dirs[i].count * sizeof(char *));
+        index_name_count += index_dirs[i].count;
+    }
+
+    qsort(index_names, index_name_count,
+          sizeof(char *), compare_strings);
+
+    int unique = 0;
+    for (int i = 0; i < index_name_count; i++) {
+        if (unique == 0 ||
+            strcmp(index_names[unique - 1], index_names[i]) != 0)
+            index_names[unique++] = index_names[i];
+    }
+    index_name_count = unique;
+
+    index_masks = malloc(index_name_count * sizeof(char_mask_t));
+    for (int i = 0; index_masks && i < index_name_count; i++)
+        index_masks[i] = fuzzy_mask(index_names[i], strlen(index_names[i]));
+}
+
+#ifndef __seele__
+/* Stale directories are shared out to a few threads, each taking the
+ * next one off the list, so a cold Tab waits for the slowest
+ * directory rather than for all of them in turn. Each listing lands
+ * in its own PATH slot and merge_names walks them in PATH order. */
+typedef struct {
+    path_dir_t **dirs;
+    int count;
+    int next;
+    pthread_mutex_t lock;
+} scan_queue_t;
+
+static void *scan_worker(void *arg) {
+    scan_queue_t *q = arg;
+    while (1) {
+        pthread_mutex_lock(&q->lock);
+        int i = q->next < q->count ? q->next++ : -1;
+        pthread_mutex_unlock(&q->lock);
+        if (i < 0) return NULL;
+        scan_dir(q->dirs[i]);
+    }
+}
+
+static void scan_dirs(path_dir_t **dirs, int count) {
+    scan_queue_t q = { dirs, count, 0, PTHREAD_MUTEX_INITIALIZER };
+    pthread_t threads[PATH_SCAN_THREADS];
+    int started = 0;
+
+    if (count > 1) {
+        int want = count < PATH_SCAN_THREADS ? count : PATH_SCAN_THREADS;
+        for (; started < want - 1; started++) {
+            if (pthread_create(&threads[started], NULL, scan_worker, &q))
+                break;
+        }
+    }
+    scan_worker(&q);
+    for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+}
+#else
+static void scan_dirs(path_dir_t **dirs, int count) {
+    for (int i = 0; i < count; i++) scan_dir(dirs[i]);
+}
+#endif
+
+/* Returns 0 when scan_stop cut the refresh short; the index then stays
+ * stale and the next lookup finishes the job. */
+static int refresh_index(const char *path_env) {
+    /* Taken and cleared up front: a mark made while the scan runs
+     * stays set for the next refresh. */
+    int wanted = __atomic_exchange_n(&index_stale, 0, __ATOMIC_ACQ_REL);
+    int changed = 0;
+    if (!index_path || strcmp(index_path, path_env) != 0) {
+        load_dirs(path_env);
+        changed = 1;
+        wanted = 1;
+    }
+    if (!wanted) return 1;
+
+    path_dir_t **stale = malloc((index_dir_count + 1) * sizeof(path_dir_t *));
+    if (!stale) {
+        path_index_mark_stale();
+        return 1;
+    }
+    int stale_count = 0;
+    for (int i = 0; i < index_dir_count; i++) {
+        path_dir_t *d = &index_dirs[i];
+        struct stat st;
+        time_t mtime = (stat(d->path, &st) == 0) ? st.st_mtime : 0;
+        if (d->mtime == (time_t)-1 || mtime != d->mtime)
+            stale[stale_count++] = d;
+    }
+    if (stale_count > 0) {
+        scan_dirs(stale, stale_count);
+        changed = 1;
+    }
+    free(stale);
+
+    /* Listings that were completed are merged either way. */
+    if (changed) merge_names();
+    if (scan_stopped()) {
+        path_index_mark_stale();
+        return 0;
+    }
+    return 1;
+}
+
+/* Refresh the index for path_env, giving up when stop returns true;
+ * returns 0 if it did. For the precompute worker, which must not read
+ * the environment the shell is changing. */
+int path_index_warm(const char *path_env, int (*stop)(void)) {
+    scan_stop = stop;
+    int done = refresh_index(path_env);
+    scan_stop = NULL;
+    return done;
+}
+
+void path_index_mark_stale(void) {
+    __atomic_store_n(&index_stale, 1, __ATOMIC_RELEASE);
+}
+
+void path_index_rehash(void) {
+    free(index_names);
+    free(index_masks);
+    index_names = NULL;
+    index_masks = NULL;
+    index_name_count = 0;
+    free_dirs();
+    free(index_path);
+    index_path = NULL;
+    path_index_mark_stale();
+}
+
+/* Names that start with prefix, and their masks when masks is given
+ * (NULL if they could not be built). */
+int path_index_lookup(const char *prefix, char ***first,
+                      const char_mask_t **masks) {
+    const char *path_env = getenv("PATH");
+    refresh_index(path_env ? path_env : "");
+
+    size_t prefix_len = strlen(prefix);
+    int lo = 0, hi = index_name_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strncmp(index_names[mid], prefix, prefix_len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    int end = lo;
+    while (end < index_name_count &&
+           strncmp(index_names[end], prefix, prefix_len) == 0)
+        end++;
+
+    *first = index_names + lo;
+    if (masks) *masks = index_masks ? index_masks + lo : NULL;
+    return end - lo;
+}
@@ -0,0 +1,204 @@
+#include "quantis.h"
+#ifndef __seele__
+#include <pthread.h>
+#endif
+
+/* Speculative completion work. When typing pauses, the line editor
+ * hands the word under the cursor to a worker thread, which warms the
+ * PATH index (first word) or the listing of the directory the word
+ * names (later words), so a following Tab finds them ready.
+ *
+ * Both caches are guarded by one lock that the worker and Tab share;
+ * a Tab that arrives mid-scan waits for the scan the worker started
+ * rather than starting its own. Every edit bumps a generation counter;
+ * the worker drops a job whose generation is no longer current, and a
+ * scan in progress checks it between entries and stops. The job
+ * carries PATH and an absolute directory taken on the main thread, so
+ * the worker never reads the environment or cwd a command may be
+ * changing. */
+
+enum { JOB_NONE, JOB_PATH, JOB_DIR };
+
+#ifndef __seele__
+static pthread_mutex_t work_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_ready = PTHREAD_COND_INITIALIZER;
+static pthread_t worker;
+static int worker_state = 0;  /* 0 not started, 1 running, -1 failed */
+
+static unsigned generation = 0;
+static int job_kind = JOB_NONE;
+static unsigned job_gen = 0;
+static char job_dir[PATH_BUF];
+static char *job_path = NULL;
+static unsigned running_gen = 0;   /* generation of the job being run */
+
+/* What was last handed over, so an unchanged context is not queued
+ * again on every pause; cleared when that job is dropped unrun. */
+static int last_kind = JOB_NONE;
+static char last_dir[PATH_BUF];
+
+/* Polled by the scans the worker runs. */
+static int job_dropped(void) {
+    pthread_mutex_lock(&job_lock);
+    int dropped = (running_gen != generation);
+    pthread_mutex_unlock(&job_lock);
+    return dropped;
+}
+
+static void *precompute_worker(void *arg) {
+    (void)arg;
+    char dir[PATH_BUF];
+
+    while (1) {
+        pthread_mutex_lock(&job_lock);
+        while (job_kind == JOB_NONE)
+            pthread_cond_wait(&job_ready, &job_lock);
+        int kind = job_kind;
+        unsigned gen = job_gen;
+        memcpy(dir, job_dir, sizeof(dir));
+        char *path = job_path;
+        job_path = NULL;
+        job_kind = JOB_NONE;
+        pthread_mutex_unlock(&job_lock);
+
+        pthread_mutex_lock(&work_lock);
+        pthread_mutex_lock(&job_lock);
+        int current = (gen == generation);
+        running_gen = gen;
+        pthread_mutex_unlock(&job_lock);
+
+        int done = 0;
+        if (current && kind == JOB_PATH)
+            done = path_index_warm(path ? path : "", job_dropped);
+        else if (current)
+            done = dircache_warm(dir, job_dropped);
+        pthread_mutex_unlock(&work_lock);
+        free(path);
+
+        /* Work dropped or cut short may be wanted again later. */
+        if (!done) {
+            pthread_mutex_lock(&job_lock);
+            last_kind = JOB_NONE;
+            pthread_mutex_unlock(&job_lock);
+        }
+    }
+    return NULL;
+}
+
+/* A forked child has no worker, and a lock the worker held at the fork
+ * stays held in the child forever; start the child clean. */
+static void reset_in_child(void) {
+    pthread_mutex_init(&work_lock, NULL);
+    pthread_mutex_init(&job_lock, NULL);
+    pthread_cond_init(&job_ready, NULL);
+    worker_state = 0;
+    job_kind = JOB_NONE;
+}
+
+static int start_worker(void) {
+    if (worker_state == 0) {
+        /* Signals are for the main thread, where the handlers expect to
+         * run; the worker starts with them all blocked. */
+        sigset_t all, old;
+        sigfillset(&all);
+        pthread_sigmask(SIG_BLOCK, &all, &old);
+        worker_state =
+            pthread_create(&worker, NULL, precompute_worker, NULL) ? -1 : 1;
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+        if (worker_state > 0) {
+            pthread_detach(worker);
+            pthread_atfork(NULL, NULL, reset_in_child);
+        }
+    }
+    return worker_state > 0;
+}
+#endif
+
+void completion_lock(void) {
+#ifndef __seele__
+    pthread_mutex_lock(&work_lock);
+#endif
+}
+
+void completion_unlock(void) {
+#ifndef __seele__
+    pthread_mutex_unlock(&work_lock);
+#endif
+}
+
+/* The line changed: queued work for the old line is no longer wanted. */
+void precompute_cancel(void) {
+#ifndef __seele__
+    pthread_mutex_lock(&job_lock);
+    generation++;
+    if (job_kind != JOB_NONE) last_kind = JOB_NONE;
+    job_kind = JOB_NONE;
+    pthread_mutex_unlock(&job_lock);
+#endif
+}
+
+/* The line is done: cancel, and make a scan still running stop at its
+ * next entry. Nothing waits for it, so Enter is never held up by a
+ * slow directory; the job works from its own copy of PATH and cwd.
+ * The next line starts with nothing warmed. */
+void precompute_stop(void) {
+#ifndef __seele__
+    pthread_mutex_lock(&job_lock);
+    generation++;
+    job_kind = JOB_NONE;
+    last_kind = JOB_NONE;
+    pthread_mutex_unlock(&job_lock);
+#endif
+}
+
+/* Called after an idle gap in typing. */
+void precompute_start(linebuf_t *lb) {
+#ifndef __seele__
+    const char *line = lb_before_cursor(lb);
+    if (!line || !*line) return;
+
+    const char *last_space = strrchr(line, ' ');
+    const char *word = last_space ? last_space + 1 : line;
+
+    int kind = JOB_PATH;
+    char dir[PATH_BUF] = "";
+    if (word != line) {
+        char *expanded;
+        char rel[PATH_BUF];
+        if (!completion_dir(word, rel, sizeof(rel), &expanded)) return;
+        free(expanded);
+        const char *abs = dircache_absolute(rel, dir, sizeof(dir));
+        if (abs != dir) snprintf(dir, sizeof(dir), "%s", abs);
+        kind = JOB_DIR;
+    }
+
+    if (!start_worker()) return;
+
+    pthread_mutex_lock(&job_lock);
+    if (kind == last_kind && strcmp(dir, last_dir) == 0) {
+        pthread_mutex_unlock(&job_lock);
+        return;
+    }
+    char *path = NULL;
+    if (kind == JOB_PATH) {
+        const char *env = getenv("PATH");
+        path = strdup(env ? env : "");
+        if (!path) {
+            pthread_mutex_unlock(&job_lock);
+            return;
+        }
+    }
+    last_kind = kind;
+    memcpy(last_dir, dir, sizeof(dir));
+    job_kind = kind;
+    job_gen = generation;
+    memcpy(job_dir, dir, sizeof(dir));
+    free(job_path);
+    job_path = path;
+    pthread_cond_signal(&job_ready);
+    pthread_mutex_unlock(&job_lock);
+#else
+    (void)lb;
+#endif
+}
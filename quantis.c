@@ -1,14 +1,16 @@
 #include "quantis.h"
 
-volatile pid_t child_pid = 0;
+pid_t fg_pgid = 0;
 int run = 1;
+int last_status = 0;
 struct termios saved_tattr;
 
-alias_t aliases[MAX_ALIASES];
+alias_t *aliases = NULL;
 int alias_count = 0;
+int alias_cap = 0;
+unsigned alias_generation = 1;
 
-char *history[MAX_HISTORY];
-int history_count = 0;
+history_t history = { NULL, 0, 0, 0, 0, NULL, 0, 1, 1 };
 int history_current = 0;
 
 int main(int argc, char *argv[]) {
@@ -14,15 +14,23 @@
 #include <sys/wait.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <limits.h>
+#include <time.h>
+#ifndef __seele__
+#include <spawn.h>
+#endif
 
 #define MAX_ARGS 128
 #define PROMPT_BUF 512
-#define MAX_ALIASES 50
 #define MAX_HISTORY 1000
-#define MAX_LINE 1024
+#define ALIAS_JOURNAL_SLACK 64
+#define HISTORY_COMPACT_SIZE (256 * 1024)
 #define PATH_BUF 4096
-#define MAX_COMPLETIONS 256
+#define DIRCACHE_BUDGET (8 * 1024 * 1024)
+#define PATH_SCAN_THREADS 8
+#define PRECOMPUTE_IDLE_MS 150
+#define FUZZY_NO_MATCH INT_MIN
 #define _VER "1.0_dev"
 #define COL_RESET "\033[0m"
 #define FG_BLACK "\033[30m"
@@ -33,57 +41,381 @@
 #define BG_PURPLE "\033[48;2;168;162;238m"
 #define BG_CYAN "\033[48;2;100;220;240m"
 
+/* Per-line bump allocator: everything parsed from one command line
+ * lives here and goes in a single reset. Sizes are rounded up to
+ * ARENA_ALIGN and data starts on that boundary, so every allocation
+ * is aligned to it. */
+#define ARENA_ALIGN 16
+
+typedef struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;
+    size_t used;
+    _Alignas(ARENA_ALIGN) char data[];
+} arena_chunk_t;
+
+typedef struct {
+    arena_chunk_t *head;
+} arena_t;
+
+enum {
+    TOK_WORD,
+    TOK_PIPE,
+    TOK_AND,
+    TOK_OR,
+    TOK_SEMI,
+    TOK_AMP,
+    TOK_REDIR,
+    TOK_END
+};
+
+enum { REDIR_IN, REDIR_OUT, REDIR_APPEND, REDIR_DUP };
+
+#define WORD_EXPAND 1  /* has quotes, escapes, $ or a leading ~ */
+
+typedef struct {
+    int type;
+    char *text;   /* points into the line */
+    size_t len;
+    int flags;
+    int fd;       /* TOK_REDIR: the descriptor being redirected */
+    int redir;    /* TOK_REDIR: REDIR_* */
+} token_t;
+
+typedef struct {
+    char *text;
+    int flags;
+} word_t;
+
 typedef struct {
     char *name;
     char *value;
+    char *words;        /* lexed copy of value; argv points into it */
+    word_t *argv;
+    int argc;
+    int bg;
+    word_t *expanded;   /* argv with nested aliases resolved */
+    int expanded_argc;
+    int expanded_bg;
+    unsigned expanded_gen;
+    int resolving;
 } alias_t;
 
-extern volatile pid_t child_pid;
+typedef struct redir {
+    int fd;
+    int kind;
+    word_t target;  /* file name, or the source fd for REDIR_DUP */
+    struct redir *next;
+} redir_t;
+
+typedef struct command {
+    word_t *words;
+    int nwords;
+    redir_t *redirs;
+    struct command *next;  /* next stage of the pipeline */
+} command_t;
+
+enum { LIST_SEQ, LIST_AND, LIST_OR };
+
+typedef struct pipeline {
+    command_t *first;
+    int stages;
+    int bg;
+    const char *source;  /* the pipeline as typed */
+    int op;              /* how the following pipeline is chained */
+    struct pipeline *next;
+} pipeline_t;
+
+/* One redirection as the child must apply it: dup2(src, fd). */
+typedef struct {
+    int fd;
+    int src;
+} fd_map_t;
+
+/* One command of a pipeline, expanded and ready to start. */
+typedef struct {
+    char **argv;
+    const fd_map_t *redirs;
+    int nredirs;
+} stage_t;
+
+enum { PROC_RUNNING, PROC_STOPPED, PROC_DONE };
+
+typedef struct {
+    pid_t pid;
+    int state;
+    int status;  /* wait status once stopped or done */
+} job_proc_t;
+
+typedef struct job {
+    int id;
+    pid_t pgid;
+    job_proc_t *procs;
+    int nprocs;
+    int cap;
+    char *command;
+    unsigned order;  /* when last started or stopped, for %+ and %- */
+    int notify;      /* changed state while in the background */
+    struct job *next;
+} job_t;
+
+typedef struct {
+    const char *text;
+    size_t len;
+    unsigned seq;
+} hist_entry_t;
+
+enum {
+    KEY_EOF,
+    KEY_CHAR,
+    KEY_TEXT,
+    KEY_PASTE,
+    KEY_ALT,
+    KEY_ESC,
+    KEY_UP,
+    KEY_DOWN,
+    KEY_LEFT,
+    KEY_RIGHT,
+    KEY_WORD_LEFT,
+    KEY_WORD_RIGHT,
+    KEY_HOME,
+    KEY_END,
+    KEY_DELETE,
+    KEY_INTERRUPT,
+    KEY_RESIZE
+};
+
+/* What event_wait saw; several can come back at once. */
+enum {
+    EV_INPUT = 1,
+    EV_INTERRUPT = 2,
+    EV_CHILD = 4,
+    EV_RESIZE = 8,
+    EV_TIMEOUT = 16
+};
+
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t gap_start;
+    size_t gap_end;
+    size_t dirty_from;
+} linebuf_t;
+
+/* Characters a name contains, as a bit set; see fuzzy_mask. */
+typedef unsigned long long char_mask_t;
+
+typedef struct {
+    char *arena;
+    size_t arena_len;
+    size_t arena_cap;
+    size_t *offsets;
+    int *scores;
+    int count;
+    int offsets_cap;
+    int ranked;
+    int *slots;
+    size_t slot_cap;
+    char **items;
+    size_t common_len;
+} comp_set_t;
+
+typedef struct {
+    int type;
+    char ch;
+    const char *text;
+    size_t len;
+} key_event_t;
+
+typedef struct {
+    hist_entry_t *entries;
+    int cap;
+    int head;
+    int count;          /* slots in use, tombstones included */
+    int dead;           /* tombstones left by dedup */
+    const char *map;
+    size_t map_len;
+    unsigned base_seq;  /* sequence number of logical index 0 */
+    unsigned next_seq;
+} history_t;
+
+extern pid_t fg_pgid;
 extern int run;
+extern int last_status;
 extern struct termios saved_tattr;
-extern alias_t aliases[MAX_ALIASES];
+extern alias_t *aliases;
 extern int alias_count;
-extern char *history[MAX_HISTORY];
-extern int history_count;
+extern int alias_cap;
+extern unsigned alias_generation;
+extern history_t history;
 extern int history_current;
 
 /* terminal */
 void reset_terminal(void);
 void set_raw_mode(void);
-void sigint_handler(int s);
+void terminal_give(pid_t pgid);
+void terminal_reclaim(void);
+
+/* event loop */
+void events_init(void);
+int event_wait(int timeout_ms, int want_input);
 
 /* path helpers */
 char *expand_tilde(const char *path);
+const char *path_next(const char *path, char *dir, size_t size);
 char *get_program_directory(void);
 
 /* prompt and input */
+int read_key(key_event_t *ev);
+int key_pending(void);
+int key_wait(int timeout_ms);
 char *build_prompt(void);
-int handle_tab_completion(char *line_buffer, int *len);
-char *read_command_line(int prompt_len);
+int handle_tab_completion(linebuf_t *lb);
+int reverse_search(linebuf_t *lb, key_event_t *next);
+char *read_command_line(const char *prompt);
+void render_begin(const char *prompt);
+void render_text(const char *a, size_t alen, const char *b, size_t blen,
+                 size_t cursor, size_t from);
+void render_hint(const char *text, size_t len);
+void render_line(const char *text, size_t len, size_t cursor);
+void render_message(const char *msg);
+void render_end(void);
+void render_resize(void);
+
+/* line editing buffer */
+void lb_init(linebuf_t *lb);
+void lb_free(linebuf_t *lb);
+size_t lb_len(const linebuf_t *lb);
+char lb_char_at(const linebuf_t *lb, size_t pos);
+void lb_move_to(linebuf_t *lb, size_t pos);
+int lb_insert(linebuf_t *lb, const char *text, size_t n);
+void lb_delete_back(linebuf_t *lb, size_t n);
+void lb_delete_forward(linebuf_t *lb, size_t n);
+void lb_copy(const linebuf_t *lb, size_t from, size_t to, char *dst);
+void lb_set(linebuf_t *lb, const char *text, size_t n);
+const char *lb_before_cursor(linebuf_t *lb);
+char *lb_take(linebuf_t *lb);
 
 /* history */
 void add_to_history(const char *line);
 void load_history(const char *hist_file);
 void save_history(const char *hist_file);
+void history_queue_write(const char *line);
+void history_flush(void);
+void history_sync(void);
+void history_push(char *line);
+void history_push_ref(const char *text, size_t len);
+void history_unmap(void);
+const char *history_get(int index, size_t *len);
+const char *history_get_seq(unsigned seq, size_t *len);
+int history_seq_index(unsigned seq);
+unsigned history_seq_at(int index);
+int history_dedup_enabled(void);
+int history_default_capacity(void);
+void history_set_capacity(int cap);
+void history_clear(void);
+void history_free(void);
+unsigned history_intern_find(const char *text, size_t len);
+void history_intern_add(unsigned seq, const char *text, size_t len);
+void history_intern_remove(const char *text, size_t len);
+void history_intern_reset(void);
+void history_index_add(unsigned seq, const char *text, size_t len);
+void history_index_reset(void);
+unsigned history_search(const char *query, size_t qlen, unsigned before);
+void history_trie_add(unsigned seq, const char *text, size_t len);
+void history_trie_reset(void);
+const char *history_suggest(const char *prefix, size_t plen,
+                            size_t *rest_len);
 
 /* aliases */
 char *extract_alias_value(const char *input);
-void add_alias(const char *name, const char *value);
+int add_alias(const char *name, const char *value);
 void remove_alias(const char *name);
+alias_t *find_alias(const char *name);
+void free_aliases(void);
 void save_aliases(const char *rc_file);
-char *expand_aliases(const char *input_line);
+void flush_aliases(const char *rc_file);
+void journal_alias(const char *rc_file, const char *name, const char *value);
+void alias_journal_loaded(const char *rc_file, const struct stat *st,
+                          long offset, int records);
+long replay_aliases(int fd, long offset, int *records);
+char **expand_alias_argv(arena_t *a, char **argv, int argc, int *bg);
 void load_aliases(const char *rc_file);
 
 /* completion helpers */
 int is_executable(const char *path);
-int find_executables_in_path(const char *prefix, char **completions, int max_comp);
-int find_file_completions(const char *prefix, char **completions, int max_comp);
+int find_executables_in_path(const char *prefix, comp_set_t *set);
+int find_file_completions(const char *prefix, comp_set_t *set);
 int compare_strings(const void *a, const void *b);
+void comp_init(comp_set_t *set);
+void comp_free(comp_set_t *set);
+int comp_add(comp_set_t *set, const char *lead, size_t lead_len,
+             const char *name);
+int comp_add_scored(comp_set_t *set, const char *lead, size_t lead_len,
+                    const char *name, int score);
+void comp_finish(comp_set_t *set);
+const char *completion_dir(const char *word, char *dir_path, size_t size,
+                           char **expanded);
+void completion_lock(void);
+void completion_unlock(void);
+void precompute_start(linebuf_t *lb);
+void precompute_cancel(void);
+void precompute_stop(void);
+int fuzzy_enabled(void);
+int fuzzy_score(const char *query, size_t qlen, const char *text,
+                size_t tlen);
+char_mask_t fuzzy_mask(const char *text, size_t len);
+
+/* PATH executable index */
+int path_index_lookup(const char *prefix, char ***first,
+                      const char_mask_t **masks);
+int path_index_warm(const char *path_env, int (*stop)(void));
+void path_index_mark_stale(void);
+void path_index_rehash(void);
+
+/* directory listing cache */
+int dircache_lookup(const char *dir, const char *prefix, char ***first,
+                    const char_mask_t **masks);
+const char *dircache_absolute(const char *dir, char *buf, size_t size);
+int dircache_warm(const char *dir, int (*stop)(void));
+void dircache_clear(void);
+
+/* resolved command hash */
+size_t hash_bytes(const char *s, size_t len);
+size_t hash_string(const char *s);
+const char *cmd_hash_resolve(const char *name);
+int cmd_hash_add(const char *name);
+void cmd_hash_forget(const char *name);
+void cmd_hash_clear(void);
+void cmd_hash_list(void);
 
 /* parsing and execution */
-int parse_line(char *line, char **argv, int *bg);
+void arena_init(arena_t *a);
+void *arena_alloc(arena_t *a, size_t size);
+char *arena_strndup(arena_t *a, const char *s, size_t len);
+void arena_reset(arena_t *a);
+void arena_free(arena_t *a);
+int lex_line(arena_t *a, char *line, token_t **tokens, int *ntokens);
+pipeline_t *parse_tokens(arena_t *a, token_t *tokens, int ntokens);
+pipeline_t *parse_command_line(arena_t *a, char *line, int *error);
+char *expand_word(arena_t *a, const word_t *w);
+void run_list(arena_t *a, pipeline_t *list, char *rc_file, char *hist_file);
+int is_builtin(const char *name);
 int handle_builtin(char **argv, char *rc_file, char *hist_file);
-void execute_command(char **argv, int bg);
+void execute_pipeline(const stage_t *stages, int n, int bg,
+                      const char *source, char *rc_file, char *hist_file);
+
+/* jobs */
+job_t *job_start(pid_t pgid, const char *command);
+void job_add_proc(job_t *j, pid_t pid);
+void job_wait(job_t *j);
+void jobs_reap(void);
+void jobs_notify(void);
+void jobs_list(void);
+void job_foreground(const char *spec);
+void job_background(const char *spec);
+void jobs_wait(char **argv);
+void jobs_kill(char **argv);
 
 /* shell lifecycle */
 void ensure_file(const char *path, const char *def);
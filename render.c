@@ -0,0 +1,329 @@
+#include "quantis.h"
+#ifndef __seele__
+#include <sys/ioctl.h>
+#endif
+
+/* The line editor draws through this module: every change is staged
+ * in one buffer, diffed against what is already on screen, and sent
+ * with a single write().
+ *
+ * Positions on screen are counted in columns from the start of the
+ * prompt's last line; the terminal width turns them into a row and a
+ * column, so a line that wraps is still drawn and walked correctly. */
+
+static char *out = NULL;
+static size_t out_len = 0;
+static size_t out_cap = 0;
+
+static const char *frame_prompt = NULL;
+static const char *prompt_tail = NULL;   /* the prompt's last line */
+static int redraw_tail = 0;
+static size_t prompt_cols = 0;
+static size_t term_width = 80;
+static char *shown = NULL;
+static size_t shown_len = 0;
+static size_t shown_cap = 0;
+static size_t shown_cursor = 0;
+static size_t shown_col = 0;     /* screen position of shown_cursor */
+static int frame_valid = 0;
+
+/* Ghost text drawn dimmed after the line; hint is what the next frame
+ * should show, shown_hint what the terminal has now. */
+static const char *hint = NULL;
+static size_t hint_len = 0;
+static char *shown_hint = NULL;
+static size_t shown_hint_len = 0;
+
+static void out_put(const char *s, size_t len) {
+    if (out_len + len > out_cap) {
+        size_t new_cap = out_cap ? out_cap : 1024;
+        while (new_cap < out_len + len) new_cap *= 2;
+        char *grown = realloc(out, new_cap);
+        if (!grown) return;
+        out = grown;
+        out_cap = new_cap;
+    }
+    memcpy(out + out_len, s, len);
+    out_len += len;
+}
+
+static void out_str(const char *s) {
+    out_put(s, strlen(s));
+}
+
+static void out_flush(void) {
+    const char *p = out;
+    size_t len = out_len;
+    while (len > 0) {
+        ssize_t n = write(STDOUT_FILENO, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    out_len = 0;
+}
+
+/* Terminal columns taken by text[from, to): UTF-8 continuation bytes
+ * do not advance the cursor. */
+static size_t columns(const char *text, size_t from, size_t to) {
+    size_t cols = 0;
+    for (size_t i = from; i < to; i++) {
+        if (((unsigned char)text[i] & 0xc0) != 0x80) cols++;
+    }
+    return cols;
+}
+
+static size_t terminal_width(void) {
+#ifndef __seele__
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0)
+        return ws.ws_col;
+#endif
+    return 80;
+}
+
+/* Columns taken by the prompt's last line, skipping escape sequences. */
+static size_t prompt_width(const char *prompt) {
+    const char *nl = strrchr(prompt, '\n');
+    const char *p = nl ? nl + 1 : prompt;
+    size_t cols = 0;
+
+    while (*p) {
+        if (p[0] == '\033' && p[1] == '[') {
+            p += 2;
+            while (*p && (*p < 0x40 || *p > 0x7e)) p++;
+            if (*p) p++;
+            continue;
+        }
+        if (((unsigned char)*p & 0xc0) != 0x80) cols++;
+        p++;
+    }
+    return cols;
+}
+
+static void move_by(size_t n, char dir) {
+    if (n == 0) return;
+    char seq[24];
+    snprintf(seq, sizeof(seq), "\033[%zu%c", n, dir);
+    out_str(seq);
+}
+
+/* Move the cursor between two screen positions, by rows and then
+ * columns. */
+static void move_to(size_t from, size_t to) {
+    size_t from_row = from / term_width, to_row = to / term_width;
+    size_t from_col = from % term_width, to_col = to % term_width;
+
+    if (to_row < from_row) move_by(from_row - to_row, 'A');
+    else move_by(to_row - from_row, 'B');
+    if (to_col < from_col) move_by(from_col - to_col, 'D');
+    else move_by(to_col - from_col, 'C');
+}
+
+/* Output that ends in the last column leaves the cursor there, waiting
+ * to wrap; take it to the next row so it is where move_to expects. */
+static void settle(size_t end) {
+    if (end > 0 && end % term_width == 0) out_str("\r\n");
+}
+
+/* The line arrives as up to two pieces (a gap buffer's halves); these
+ * helpers treat them as one string. */
+typedef struct {
+    const char *a;
+    size_t alen;
+    const char *b;
+    size_t blen;
+} line_view_t;
+
+static char view_at(const line_view_t *v, size_t i) {
+    return i < v->alen ? v->a[i] : v->b[i - v->alen];
+}
+
+static void view_put(const line_view_t *v, size_t from, size_t to) {
+    if (from < v->alen)
+        out_put(v->a + from, (to < v->alen ? to : v->alen) - from);
+    if (to > v->alen) {
+        size_t start = from > v->alen ? from - v->alen : 0;
+        out_put(v->b + start, to - v->alen - start);
+    }
+}
+
+/* Bring shown[] up to date from offset p on. */
+static void remember(const line_view_t *v, size_t p, size_t cursor) {
+    size_t len = v->alen + v->blen;
+    if (len + 1 > shown_cap) {
+        size_t new_cap = shown_cap ? shown_cap : 256;
+        while (new_cap < len + 1) new_cap *= 2;
+        char *grown = realloc(shown, new_cap);
+        if (!grown) {
+            frame_valid = 0;
+            return;
+        }
+        shown = grown;
+        shown_cap = new_cap;
+    }
+    for (size_t i = p; i < len; i++) shown[i] = view_at(v, i);
+    shown_len = len;
+    shown_cursor = cursor;
+    frame_valid = 1;
+}
+
+static void remember_hint(void) {
+    char *grown = realloc(shown_hint, hint_len ? hint_len : 1);
+    if (!grown) {
+        frame_valid = 0;
+        return;
+    }
+    shown_hint = grown;
+    if (hint_len) memcpy(shown_hint, hint, hint_len);
+    shown_hint_len = hint_len;
+}
+
+static void put_hint(void) {
+    if (hint_len == 0) return;
+    out_str("\033[90m");
+    out_put(hint, hint_len);
+    out_str("\033[0m");
+}
+
+void render_begin(const char *prompt) {
+    frame_prompt = prompt;
+    prompt_tail = prompt ? strrchr(prompt, '\n') : NULL;
+    prompt_tail = prompt_tail ? prompt_tail + 1 : prompt;
+    redraw_tail = 0;
+    prompt_cols = prompt ? prompt_width(prompt) : 0;
+    term_width = terminal_width();
+    frame_valid = 0;
+    hint = NULL;
+    hint_len = 0;
+}
+
+/* Set the ghost text for the next frame; text must stay valid until
+ * then. */
+void render_hint(const char *text, size_t len) {
+    hint = text;
+    hint_len = text ? len : 0;
+}
+
+/* Draw the line a+b with the cursor at byte offset cursor. Nothing
+ * before offset from has changed since the last frame, so the diff and
+ * the output both start there: a mid-line edit costs the tail only. */
+void render_text(const char *a, size_t alen, const char *b, size_t blen,
+                 size_t cursor, size_t from) {
+    line_view_t v = { a, alen, b, blen };
+    size_t len = alen + blen;
+
+    size_t hint_cols = columns(hint, 0, hint_len);
+
+    if (!frame_valid) {
+        if (frame_prompt) out_str(redraw_tail ? prompt_tail : frame_prompt);
+        redraw_tail = 0;
+        view_put(&v, 0, len);
+        put_hint();
+        remember(&v, 0, cursor);
+        if (frame_valid) remember_hint();
+        if (frame_valid) {
+            size_t end = prompt_cols + columns(shown, 0, len) + hint_cols;
+            settle(end);
+            shown_col = prompt_cols + columns(shown, 0, cursor);
+            move_to(end, shown_col);
+        }
+        out_flush();
+        return;
+    }
+
+    size_t p = from;
+    if (p > len) p = len;
+    if (p > shown_len) p = shown_len;
+    while (p < len && p < shown_len && view_at(&v, p) == shown[p]) p++;
+
+    int hint_same = hint_len == shown_hint_len &&
+                    (hint_len == 0 || memcmp(hint, shown_hint, hint_len) == 0);
+
+    if (p == len && len == shown_len && hint_same) {
+        size_t col = cursor < shown_cursor
+                         ? shown_col - columns(shown, cursor, shown_cursor)
+                         : shown_col + columns(shown, shown_cursor, cursor);
+        move_to(shown_col, col);
+        shown_cursor = cursor;
+        shown_col = col;
+        out_flush();
+        return;
+    }
+
+    size_t p_col = p < shown_cursor
+                       ? shown_col - columns(shown, p, shown_cursor)
+                       : shown_col + columns(shown, shown_cursor, p);
+    move_to(shown_col, p_col);
+
+    size_t old_end = p_col + columns(shown, p, shown_len) +
+                     columns(shown_hint, 0, shown_hint_len);
+    view_put(&v, p, len);
+    put_hint();
+    remember(&v, p, cursor);
+    if (frame_valid) remember_hint();
+    if (!frame_valid) {
+        out_flush();
+        return;
+    }
+    size_t end = p_col + columns(shown, p, len) + hint_cols;
+    if (end > p_col) settle(end);
+    if (old_end > end) out_str("\033[J");
+    shown_col = cursor < p ? p_col - columns(shown, cursor, p)
+                           : p_col + columns(shown, p, cursor);
+    move_to(end, shown_col);
+    out_flush();
+}
+
+void render_line(const char *text, size_t len, size_t cursor) {
+    render_hint(NULL, 0);
+    render_text(text, len, NULL, 0, cursor, 0);
+}
+
+/* Take the cursor past the end of the line and clear any hint, ready
+ * for output below it. */
+static void leave_line(void) {
+    size_t end = prompt_cols;
+    if (frame_valid) {
+        end = shown_col + columns(shown, shown_cursor, shown_len);
+        move_to(shown_col, end);
+        if (shown_hint_len) out_str("\033[J");
+    }
+    /* A line that fills its last row already has the cursor on a new
+     * one. */
+    if (!frame_valid || end == 0 || end % term_width != 0) out_str("\n");
+}
+
+/* Print text below the line being edited (e.g. a completion list);
+ * the next render_line redraws the prompt and line underneath it. */
+void render_message(const char *msg) {
+    leave_line();
+    out_str(msg);
+    frame_valid = 0;
+    out_flush();
+}
+
+void render_end(void) {
+    leave_line();
+    frame_valid = 0;
+    frame_prompt = NULL;
+    out_flush();
+}
+
+/* The terminal was resized. Using the width the line was drawn with,
+ * go up to the row the prompt's last line starts on and clear from
+ * there down; the next frame draws that line of the prompt and the
+ * text again at the new width. */
+void render_resize(void) {
+    if (frame_valid) {
+        move_to(shown_col, 0);
+        out_str("\033[J");
+        frame_valid = 0;
+        redraw_tail = 1;
+        out_flush();
+    }
+    term_width = terminal_width();
+}
@@ -0,0 +1,124 @@
+#include "quantis.h"
+
+/* Ctrl-R: incremental search backwards through history. The query and
+ * the current match are drawn in place of the line being edited. */
+
+typedef struct {
+    char *buf;
+    size_t len;
+    size_t cap;
+} strbuf_t;
+
+static void sb_put(strbuf_t *sb, const char *s, size_t len) {
+    if (sb->len + len > sb->cap) {
+        size_t new_cap = sb->cap ? sb->cap : 128;
+        while (new_cap < sb->len + len) new_cap *= 2;
+        char *grown = realloc(sb->buf, new_cap);
+        if (!grown) return;
+        sb->buf = grown;
+        sb->cap = new_cap;
+    }
+    memcpy(sb->buf + sb->len, s, len);
+    sb->len += len;
+}
+
+static void show(strbuf_t *frame, const strbuf_t *query, unsigned match,
+                 int failed) {
+    static const char head[] = "(reverse-i-search)`";
+    static const char failed_head[] = "(failed reverse-i-search)`";
+
+    frame->len = 0;
+    if (failed) sb_put(frame, failed_head, sizeof(failed_head) - 1);
+    else sb_put(frame, head, sizeof(head) - 1);
+    if (query->len) sb_put(frame, query->buf, query->len);
+    sb_put(frame, "': ", 3);
+
+    size_t len = 0;
+    const char *text = match ? history_get_seq(match, &len) : NULL;
+    if (text) sb_put(frame, text, len);
+    render_line(frame->buf, frame->len, frame->len);
+}
+
+/* Returns 1 when Enter accepted the match, 0 when editing continues,
+ * and -1 on end of input. As in readline, any other key that ends the
+ * search (an arrow, Home, Ctrl-A...) keeps the match and is stored in
+ * next for the editor to apply; the return value is then 2. */
+int reverse_search(linebuf_t *lb, key_event_t *next) {
+    strbuf_t query = { NULL, 0, 0 };
+    strbuf_t frame = { NULL, 0, 0 };
+    unsigned newest = history.next_seq;
+    unsigned match = 0;
+    int failed = 0;
+    int result = 0;
+
+    while (1) {
+        if (!key_pending()) show(&frame, &query, match, failed);
+
+        key_event_t key;
+        if (!read_key(&key)) {
+            result = -1;
+            break;
+        }
+
+        if (key.type == KEY_TEXT || key.type == KEY_PASTE) {
+            /* A longer query can still match the current entry, so the
+             * search restarts from it rather than from the one before. */
+            sb_put(&query, key.text, key.len);
+            unsigned found = history_search(query.buf, query.len,
+                                            match ? match + 1 : newest);
+            failed = !found;
+            if (found) match = found;
+            continue;
+        }
+        if (key.type == KEY_RESIZE) {
+            render_resize();
+            continue;
+        }
+        if (key.type == KEY_INTERRUPT) {
+            match = 0;
+            break;
+        }
+        if (key.type == KEY_ESC) break;
+        if (key.type != KEY_CHAR) {
+            *next = key;
+            result = 2;
+            break;
+        }
+
+        if (key.ch == 18) {  /* Ctrl-R: next older match */
+            unsigned found = history_search(query.buf, query.len,
+                                            match ? match : newest);
+            failed = !found;
+            if (found) match = found;
+            continue;
+        }
+        if (key.ch == 127 || key.ch == '\b') {
+            while (query.len > 0 &&
+                   ((unsigned char)query.buf[--query.len] & 0xc0) == 0x80)
+                ;
+            match = history_search(query.buf, query.len, newest);
+            failed = query.len > 0 && !match;
+            continue;
+        }
+        if (key.ch == 7) {  /* Ctrl-G: back to the original line */
+            match = 0;
+            break;
+        }
+        if (key.ch == '\r' || key.ch == '\n') {
+            result = 1;
+        } else {
+            *next = key;
+            result = 2;
+        }
+        break;
+    }
+
+    size_t len = 0;
+    const char *text = match ? history_get_seq(match, &len) : NULL;
+    if (text) lb_set(lb, text, len);
+    lb->dirty_from = 0;
+
+    free(query.buf);
+    free(frame.buf);
+    return result;
+}
@@ -2,12 +2,9 @@
 #include <stdio.h>
 
 int run_shell(void) {
-    set_raw_mode();
-
     char *input = NULL;
     char *prompt = NULL;
-    char *args[MAX_ARGS];
-    int bg;
+    arena_t arena;
 
     char *prog_dir = get_program_directory();
     char *rc = malloc(strlen(prog_dir) + 20);
@@ -28,18 +25,21 @@ int run_shell(void) {
     if (!getenv("COLORTERM"))
         setenv("COLORTERM", "truecolor", 1);
 
+    /* Clear first: the reset would also undo the modes that
+     * set_raw_mode turns on. */
     printf("\033c");
+    fflush(stdout);
+    set_raw_mode();
     load_aliases(rc);
     load_history(hist);
+    arena_init(&arena);
 
     while (run) {
+        jobs_notify();
+        history_sync();
         prompt = build_prompt();
-        printf("%s", prompt);
         fflush(stdout);
-
-        /* Do not rely on getpwuid/getcwd for prompt length; the
-         * argument is currently ignored by read_command_line. */
-        input = read_command_line(0);
+        input = read_command_line(prompt);
 
         free(prompt);
 
@@ -51,44 +51,27 @@ int run_shell(void) {
         }
 
         add_to_history(input);
+        history_flush();
+
+        /* Parsing cuts the line up in place, so it comes after the
+         * line has been recorded. */
+        int err;
+        pipeline_t *list = parse_command_line(&arena, input, &err);
+        if (err)
+            last_status = 2;
+        else if (list)
+            run_list(&arena, list, rc, hist);
+        arena_reset(&arena);
 
-        char *expanded = expand_aliases(input);
         free(input);
-
-        if (!expanded) continue;
-
-        char *dup = strdup(expanded);
-        if (!dup) {
-            perror("strdup for parsing");
-            free(expanded);
-            continue;
-        }
-
-        int argc_parsed = parse_line(dup, args, &bg);
-
-        if (argc_parsed == 0) {
-            free(dup);
-            free(expanded);
-            continue;
-        }
-
-        if (!handle_builtin(args, rc, hist))
-            execute_command(args, bg);
-
-        free(dup);
-        free(expanded);
     }
 
     save_history(hist);
-    save_aliases(rc);
+    flush_aliases(rc);
 
-    for (int i = 0; i < alias_count; i++) {
-        free(aliases[i].name);
-        free(aliases[i].value);
-    }
-    for (int i = 0; i < history_count; i++) {
-        free(history[i]);
-    }
+    free_aliases();
+    history_free();
+    arena_free(&arena);
 
     free(rc);
     free(hist);
@@ -0,0 +1,90 @@
+/* Spawn latency: fork+execve against posix_spawn, with the parent
+ * holding a given amount of touched memory so the cost of copying its
+ * page tables shows up. The two are interleaved, alternating which
+ * goes first, so neither gains from the other warming caches or
+ * settling copy-on-write state. Linux only; excluded from the seele
+ * build.
+ *
+ *     gcc -O2 spawn_bench.c -o /tmp/spawn_bench
+ *     /tmp/spawn_bench [iterations] [resident MB] */
+
+#define _GNU_SOURCE
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* Each returns the time one launch took, in microseconds, or -1 when
+ * the launch failed; a failed run would only look fast. */
+static double run_fork(char **argv) {
+    double t = now_us();
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        execve(argv[0], argv, environ);
+        _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+    return now_us() - t;
+}
+
+static double run_spawn(char **argv) {
+    double t = now_us();
+    pid_t pid;
+    if (posix_spawn(&pid, argv[0], NULL, NULL, argv, environ) != 0)
+        return -1;
+    waitpid(pid, NULL, 0);
+    return now_us() - t;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000;
+    size_t mb = argc > 2 ? (size_t)atoi(argv[2]) : 0;
+    char *child[] = { "/bin/true", NULL };
+
+    char *ballast = NULL;
+    if (mb) {
+        ballast = malloc(mb << 20);
+        if (!ballast) return 1;
+        memset(ballast, 1, mb << 20);
+    }
+
+    double fork_us = 0, spawn_us = 0;
+    for (int i = 0; i < iterations; i++) {
+        double f, s;
+        if (i & 1) {
+            s = run_spawn(child);
+            f = run_fork(child);
+        } else {
+            f = run_fork(child);
+            s = run_spawn(child);
+        }
+        if (f < 0 || s < 0) {
+            fprintf(stderr, "%s failed on run %d: %s\n",
+                    f < 0 ? "fork" : "posix_spawn", i, strerror(errno));
+            free(ballast);
+            return 1;
+        }
+        fork_us += f;
+        spawn_us += s;
+    }
+    fork_us /= iterations;
+    spawn_us /= iterations;
+
+    printf("%zu MB resident, %d runs: fork+exec %.1f us, "
+           "posix_spawn %.1f us\n", mb, iterations, fork_us, spawn_us);
+    free(ballast);
+    return 0;
+}
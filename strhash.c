@@ -0,0 +1,15 @@
+#include "quantis.h"
+
+/* FNV-1a; shared by the shell's string-keyed tables. */
+size_t hash_bytes(const char *s, size_t len) {
+    size_t h = (size_t)14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= (size_t)1099511628211ULL;
+    }
+    return h;
+}
+
+size_t hash_string(const char *s) {
+    return hash_bytes(s, strlen(s));
+}
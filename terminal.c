@@ -1,6 +1,10 @@
 #include "quantis.h"
 
+static struct termios raw_tattr;
+
 void reset_terminal(void) {
+    if (isatty(STDOUT_FILENO))
+        write(STDOUT_FILENO, "\033[?2004l", 8);
     tcsetattr(STDIN_FILENO, TCSANOW, &saved_tattr);
 }
 
@@ -14,13 +18,29 @@ void set_raw_mode(void) {
     tattr.c_cc[VMIN] = 1;
     tattr.c_cc[VTIME] = 0;
     tcsetattr(STDIN_FILENO, TCSANOW, &tattr);
+    raw_tattr = tattr;
+
+    /* Bracketed paste lets the key reader take a paste as one block. */
+    if (isatty(STDOUT_FILENO))
+        write(STDOUT_FILENO, "\033[?2004h", 8);
 }
 
-void sigint_handler(int s) {
-    (void)s;
-    if (child_pid)
-        kill(child_pid, SIGINT);
-    else
-        write(STDOUT_FILENO, "\n", 1);
+/* A foreground job gets the terminal in the mode the shell was started
+ * with, and becomes the process group the terminal signals. */
+void terminal_give(pid_t pgid) {
+    if (!isatty(STDIN_FILENO)) return;
+    if (isatty(STDOUT_FILENO))
+        write(STDOUT_FILENO, "\033[?2004l", 8);
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &saved_tattr);
+    tcsetpgrp(STDIN_FILENO, pgid);
 }
 
+/* Take the terminal back once the job is done; whatever modes it left
+ * behind are replaced by the editor's. */
+void terminal_reclaim(void) {
+    if (!isatty(STDIN_FILENO)) return;
+    tcsetpgrp(STDIN_FILENO, getpgrp());
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &raw_tattr);
+    if (isatty(STDOUT_FILENO))
+        write(STDOUT_FILENO, "\033[?2004h", 8);
+}